@@ -0,0 +1,101 @@
+#include "devices/clock.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Monotonic high-resolution clock.
+
+   The timer interrupt only tells time to the nearest tick,
+   which is 10 ms at the default frequency.  Where the CPU has a
+   time stamp counter (TSC), we measure its rate against the
+   timer once at boot and from then on read time directly from
+   the TSC, to within a few nanoseconds, at the cost of a single
+   instruction plus a conversion.
+
+   Without a TSC, or before calibration, the clock falls back to
+   timer ticks. */
+
+/* Number of timer ticks to count TSC cycles over. */
+#define CALIBRATE_TICKS 5
+
+/* TSC cycles per second, or 0 if the TSC is not in use. */
+static uint64_t tsc_hz;
+
+/* Calibrates the TSC against the timer.  Interrupts must be
+   turned on, and the timer must already be calibrated. */
+void
+clock_init (void) 
+{
+  uint64_t start_tsc;
+  int64_t start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (!cpu_has (CPUID_TSC))
+    {
+      printf ("No time stamp counter, clock has tick resolution.\n");
+      return;
+    }
+
+  printf ("Calibrating time stamp counter...  ");
+
+  /* Start counting on a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+
+  start_tsc = rdtsc ();
+  start = timer_ticks ();
+  while (timer_elapsed (start) < CALIBRATE_TICKS)
+    barrier ();
+  tsc_hz = (rdtsc () - start_tsc) * TIMER_FREQ / CALIBRATE_TICKS;
+
+  printf ("%'"PRIu64" Hz.\n", tsc_hz);
+}
+
+/* Returns true if the clock has sub-tick resolution, that is,
+   if it is driven by the TSC. */
+bool
+clock_is_precise (void) 
+{
+  return tsc_hz != 0;
+}
+
+/* Returns the number of nanoseconds since the CPU was reset.
+   The value never decreases.  May be called from any context,
+   including interrupt handlers and with interrupts off. */
+int64_t
+clock_ns (void) 
+{
+  if (tsc_hz != 0)
+    return clock_cycles_to_ns (rdtsc ());
+  else
+    return timer_ticks () * (NSEC_PER_SEC / TIMER_FREQ);
+}
+
+/* Returns the raw clock in CPU cycles, for cheap fine-grained
+   measurements.  Convert differences between two readings to
+   nanoseconds with clock_cycles_to_ns().  Returns 0 if there is
+   no TSC. */
+uint64_t
+clock_cycles (void) 
+{
+  return tsc_hz != 0 ? rdtsc () : 0;
+}
+
+/* Converts CYCLES clock cycles to nanoseconds. */
+int64_t
+clock_cycles_to_ns (uint64_t cycles) 
+{
+  if (tsc_hz == 0)
+    return 0;
+
+  /* Split the conversion so that the intermediate products
+     cannot overflow. */
+  return (cycles / tsc_hz * NSEC_PER_SEC
+          + cycles % tsc_hz * NSEC_PER_SEC / tsc_hz);
+}
@@ -0,0 +1,16 @@
+#ifndef DEVICES_CLOCK_H
+#define DEVICES_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Nanoseconds per second. */
+#define NSEC_PER_SEC 1000000000LL
+
+void clock_init (void);
+bool clock_is_precise (void);
+int64_t clock_ns (void);
+uint64_t clock_cycles (void);
+int64_t clock_cycles_to_ns (uint64_t cycles);
+
+#endif /* devices/clock.h */
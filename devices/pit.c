@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,43 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Configures CHANNEL in mode 0, "interrupt on terminal count",
+   to count down once from COUNT PIT cycles.  On channel 0, the
+   output rises, raising interrupt line 0, when the count
+   reaches 0.  The counter then keeps counting down from 65535
+   without raising another interrupt, until the channel is
+   configured again.  COUNT must be nonzero. */
+void
+pit_configure_oneshot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0);
+  ASSERT (count != 0);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the current value of CHANNEL's down-counter, latched
+   so that its two bytes are read consistently. */
+uint16_t
+pit_read_counter (int channel)
+{
+  enum intr_level old_level;
+  uint16_t count;
+
+  ASSERT (channel >= 0 && channel <= 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  return count;
+}
@@ -5,9 +5,14 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/fpu.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
@@ -120,12 +125,18 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  workqueue_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  kmem_cache_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
+  lock_print_stats ();
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  fpu_print_stats ();
 #endif
 }
@@ -1,40 +1,122 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/clock.h"
 #include "devices/pit.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/profile.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
-#if TIMER_FREQ < 19
-#error 8254 timer requires TIMER_FREQ >= 19
-#endif
-#if TIMER_FREQ > 1000
-#error TIMER_FREQ <= 1000 recommended
+#define TIMER_FREQ_MIN 19       /* 8254 timer requires TIMER_FREQ >= 19. */
+#define TIMER_FREQ_MAX 1000     /* TIMER_FREQ <= 1000 recommended. */
+
+#if TIMER_FREQ_DEFAULT < TIMER_FREQ_MIN || TIMER_FREQ_DEFAULT > TIMER_FREQ_MAX
+#error TIMER_FREQ_DEFAULT out of range
 #endif
 
+/* Number of timer interrupts per second. */
+int timer_freq = TIMER_FREQ_DEFAULT;
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Tickless idle.
+
+   When the idle thread is about to halt the CPU, rather than
+   taking an interrupt every tick only to find nothing to do, it
+   reprograms the PIT to interrupt once, when the earliest
+   sleeping thread is due to wake up.  Whichever interrupt ends
+   the idle period, the ticks that passed are then accounted for
+   and the PIT goes back to periodic mode.
+
+   A one-shot period need not end on a tick boundary, because a
+   high-resolution sleeper may be due between ticks.  We track
+   the PIT cycles elapsed since the last tick boundary, and after
+   a one-shot period that ends between ticks, we program one more
+   one-shot period to reach the next boundary before resuming
+   periodic mode, so that no fraction of a tick is ever lost.
+
+   The same mechanism wakes high-resolution sleepers on time when
+   the CPU is busy: whenever the earliest one is due before the
+   next interrupt, hrsleep_arm() cuts the current period short
+   with a one-shot period that ends at its deadline. */
+static bool tickless = true;    /* Enable tickless idle? */
+static unsigned pit_count;      /* PIT cycles per timer tick. */
+static unsigned oneshot_count;  /* Cycles in one-shot period, 0 if none. */
+static unsigned oneshot_phase;  /* Cycles past a tick when it started. */
+static long long oneshot_cnt;   /* # of one-shot periods programmed. */
+static long long oneshot_ticks_saved; /* # of tick interrupts avoided. */
+
+/* Sub-tick sleeps shorter than this many nanoseconds busy-wait
+   instead of blocking, because reprogramming the PIT and
+   switching threads twice would take about as long. */
+#define HRSLEEP_MIN_NS 20000
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* List of threads sleeping in timer_sleep(), ordered by
+   ascending wakeup tick.  Threads with equal wakeup ticks are
+   kept in the order they went to sleep.  Accessed with
+   interrupts disabled, since timer_interrupt() drains it. */
+static struct list sleep_list;
+
+/* List of threads sleeping in timer_hrsleep(), ordered by
+   ascending wakeup time in nanoseconds.  Accessed with
+   interrupts disabled, like sleep_list. */
+static struct list hrsleep_list;
+
+/* Sleep statistics. */
+static long long sleep_cnt;         /* # of calls that blocked. */
+static long long hrsleep_cnt;       /* # of those below tick resolution. */
+static long long wakeup_cnt;        /* # of threads woken. */
+static long long wakeup_tick_cnt;   /* # of ticks that woke a thread. */
+static unsigned max_wakeups;        /* Most threads woken in one tick. */
+
 static intr_handler_func timer_interrupt;
+static void timer_advance (int64_t);
+static void oneshot_arm (unsigned phase, unsigned count);
+static void hrsleep_arm (void);
+static int cycles_since_tick (void);
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static bool hrwakeup_less (const struct list_elem *, const struct list_elem *,
+                           void *aux);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
 
+/* Sets the timer to interrupt FREQ times per second, which must
+   be between 19 and 1000, and enables or disables tickless idle
+   according to TICKLESS.  Must be called before timer_init(). */
+void
+timer_configure (int freq, bool tickless_) 
+{
+  if (freq < TIMER_FREQ_MIN || freq > TIMER_FREQ_MAX)
+    PANIC ("timer frequency %d Hz out of range %d...%d Hz",
+           freq, TIMER_FREQ_MIN, TIMER_FREQ_MAX);
+  timer_freq = freq;
+  tickless = tickless_;
+}
+
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  list_init (&sleep_list);
+  list_init (&hrsleep_list);
+  pit_count = (PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ;
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -85,15 +167,55 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The running thread is blocked on sleep_list until
+   timer_interrupt() finds that its wakeup tick has arrived, so
+   sleeping threads cost nothing while they sleep. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  sleep_cnt++;
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Sleeps for at least NS nanoseconds, as measured by clock_ns().
+   Interrupts must be turned on.
+
+   Unlike timer_sleep(), the wakeup is not rounded to a timer
+   tick: the running thread is blocked on hrsleep_list and the
+   timer is programmed to interrupt at its deadline, whether or
+   not the CPU is otherwise idle.  Without a precise clock this
+   degrades to a tick-granularity sleep. */
+void
+timer_hrsleep (int64_t ns) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ns <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_ns = clock_ns () + ns;
+  list_insert_ordered (&hrsleep_list, &cur->elem, hrwakeup_less, NULL);
+  sleep_cnt++;
+  hrsleep_cnt++;
+  hrsleep_arm ();
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -163,15 +285,299 @@ timer_ndelay (int64_t ns)
 void
 timer_print_stats (void) 
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  int64_t t = timer_ticks ();
+
+  printf ("Timer: %"PRId64" ticks at %d Hz\n", t, TIMER_FREQ);
+  if (tickless)
+    printf ("Timer: %lld tickless idle periods, %lld tick interrupts "
+            "avoided\n", oneshot_cnt, oneshot_ticks_saved);
+  printf ("Timer: %lld sleeps (%lld high-resolution), "
+          "%lld wakeups in %lld ticks, %u max wakeups/tick",
+          sleep_cnt, hrsleep_cnt, wakeup_cnt, wakeup_tick_cnt, max_wakeups);
+  if (t > 0)
+    printf (", %lld.%02lld avg wakeups/tick",
+            wakeup_cnt / t, wakeup_cnt * 100 / t % 100);
+  printf ("\n");
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  If no thread needs to wake up for a while,
+   programs the PIT to interrupt just once, when the earliest
+   sleeper is due, instead of on every tick. */
+void
+timer_idle_enter (void) 
+{
+  int since = cycles_since_tick ();
+  int64_t next, due, count;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!tickless || since < 0 || (unsigned) since >= pit_count)
+    return;
+
+  /* NEXT is the number of cycles until the next tick boundary,
+     and an event due at tick T is due NEXT + (T - ticks - 1) *
+     pit_count cycles from now. */
+  next = pit_count - since;
+  due = thread_rt_next_replenish ();
+  if (!list_empty (&sleep_list))
+    {
+      int64_t wakeup = list_entry (list_front (&sleep_list),
+                                   struct thread, elem)->wakeup_tick;
+      if (wakeup < due)
+        due = wakeup;
+    }
+  if (workqueue_next_due () < due)
+    due = workqueue_next_due ();
+  if (thread_mlfqs && ticks + TIMER_FREQ - ticks % TIMER_FREQ < due)
+    {
+      /* Don't skip the once-per-second MLFQS update. */
+      due = ticks + TIMER_FREQ - ticks % TIMER_FREQ;
+    }
+  count = 65535;
+  if (due - ticks - 1 < count / pit_count)
+    count = next + (due - ticks - 1) * pit_count;
+  if (!list_empty (&hrsleep_list))
+    {
+      int64_t ns = list_entry (list_front (&hrsleep_list),
+                               struct thread, elem)->wakeup_ns - clock_ns ();
+      if (ns < NSEC_PER_SEC)
+        {
+          int64_t hr = ns > 0 ? DIV_ROUND_UP (ns * PIT_HZ, NSEC_PER_SEC) : 1;
+          if (hr < count)
+            count = hr;
+        }
+    }
+
+  /* A one-shot period is only worthwhile if it skips at least
+     one tick or ends before the next tick. */
+  if (count >= next && count < next + pit_count)
+    return;
+
+  oneshot_arm (since, count);
+  oneshot_cnt++;
+}
+
+/* Called when the idle thread is switched out.  If the timer is
+   in one-shot mode because the idle thread halted the CPU, and
+   some other interrupt ended the idle period early, accounts for
+   the whole ticks that have passed and sets the timer to resume
+   periodic mode at the next tick boundary.  Returns the number
+   of ticks accounted for. */
+int64_t
+timer_idle_exit (void) 
+{
+  int since;
+  unsigned elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_count == 0)
+    return 0;
+
+  /* If the one-shot has expired, its interrupt is still pending
+     and will do the accounting. */
+  since = cycles_since_tick ();
+  if (since < 0)
+    return 0;
+
+  elapsed = since / pit_count;
+  since %= pit_count;
+  oneshot_arm (since, pit_count - since);
+  ticks += elapsed;
+  oneshot_ticks_saved += elapsed;
+  hrsleep_arm ();
+  return elapsed;
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
-  ticks++;
-  thread_tick ();
+  if (oneshot_count != 0)
+    {
+      /* A one-shot period has expired.  Play back the ticks that
+         went by, so that per-tick accounting in thread_tick()
+         stays exact.  Resume periodic mode if we are on a tick
+         boundary, otherwise run on to the next one. */
+      unsigned since = oneshot_phase + oneshot_count;
+      int64_t n = since / pit_count;
+
+      since %= pit_count;
+      if (since == 0)
+        {
+          oneshot_count = 0;
+          pit_configure_channel (0, 2, TIMER_FREQ);
+        }
+      else
+        oneshot_arm (since, pit_count - since);
+      if (n > 1)
+        oneshot_ticks_saved += n - 1;
+
+      /* Sample only at tick boundaries.  One-shot periods that
+         end between ticks wake high-resolution sleepers, and
+         sampling them too would over-weight the code running
+         near their deadlines. */
+      if (n >= 1 && profile_enabled)
+        profile_sample (args);
+      timer_advance (n);
+    }
+  else
+    {
+      if (profile_enabled)
+        profile_sample (args);
+      timer_advance (1);
+    }
+  hrsleep_arm ();
+}
+
+/* Programs the PIT for a one-shot period of COUNT cycles,
+   starting PHASE cycles after the last tick boundary. */
+static void
+oneshot_arm (unsigned phase, unsigned count) 
+{
+  ASSERT (count > 0 && count <= 65535);
+
+  oneshot_phase = phase;
+  oneshot_count = count;
+  pit_configure_oneshot (0, count);
+}
+
+/* If the earliest thread on hrsleep_list is due before the
+   timer's next interrupt, programs a one-shot period that ends
+   at its deadline.  The timer interrupt then resumes the tick
+   where it left off.  Interrupts must be off. */
+static void
+hrsleep_arm (void) 
+{
+  struct thread *t;
+  unsigned left, count;
+  int64_t ns;
+  int since;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (&hrsleep_list) || !clock_is_precise ())
+    return;
+
+  /* If a one-shot has expired, its interrupt is pending and will
+     call us again. */
+  since = cycles_since_tick ();
+  if (since < 0)
+    return;
+
+  if (oneshot_count != 0)
+    left = oneshot_phase + oneshot_count - since;
+  else
+    left = pit_count - since;
+  t = list_entry (list_front (&hrsleep_list), struct thread, elem);
+  ns = t->wakeup_ns - clock_ns ();
+  count = ns > 0 ? DIV_ROUND_UP (ns * PIT_HZ, NSEC_PER_SEC) : 1;
+  if (count < left)
+    {
+      oneshot_arm (since, count);
+      oneshot_cnt++;
+    }
+}
+
+/* Returns the number of PIT cycles since the last tick boundary
+   that has been accounted for in `ticks', or -1 if a one-shot
+   period has expired but its interrupt has not yet been
+   handled.  Interrupts must be off. */
+static int
+cycles_since_tick (void) 
+{
+  unsigned count = pit_read_counter (0);
+
+  if (oneshot_count == 0)
+    {
+      /* Mode 2 counts down from pit_count to 1, interrupting and
+         reloading as it goes from 1 to pit_count. */
+      return count <= pit_count ? pit_count - count : 0;
+    }
+
+  /* Mode 0 counts down from the programmed count, through 0,
+     and on down from 65535, so a count above the programmed one
+     means the one-shot has expired. */
+  if (count == 0 || count > oneshot_count)
+    return -1;
+  return oneshot_phase + (oneshot_count - count);
+}
+
+/* Advances the tick count by N ticks, calling thread_tick() for
+   each, and wakes up the sleeping threads that are due. */
+static void
+timer_advance (int64_t n) 
+{
+  unsigned woken = 0;
+
+  while (n-- > 0)
+    {
+      ticks++;
+      thread_tick ();
+    }
+
+  workqueue_tick (ticks);
+
+  /* Wake up every sleeper whose time has come.  The list is
+     sorted, so we stop at the first thread still asleep. */
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      trace_event (TRACE_WAKEUP, t, 0);
+      thread_unblock (t);
+      woken++;
+    }
+  if (woken > 0)
+    {
+      wakeup_cnt += woken;
+      wakeup_tick_cnt++;
+      if (woken > max_wakeups)
+        max_wakeups = woken;
+    }
+
+  /* Likewise for high-resolution sleepers. */
+  if (!list_empty (&hrsleep_list))
+    {
+      int64_t now = clock_ns ();
+      while (!list_empty (&hrsleep_list))
+        {
+          struct thread *t = list_entry (list_front (&hrsleep_list),
+                                         struct thread, elem);
+          if (t->wakeup_ns > now)
+            break;
+          list_pop_front (&hrsleep_list);
+          trace_event (TRACE_WAKEUP, t, 0);
+          thread_unblock (t);
+          wakeup_cnt++;
+        }
+    }
+}
+
+/* Orders threads on sleep_list by ascending wakeup tick. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
+}
+
+/* Orders threads on hrsleep_list by ascending wakeup time. */
+static bool
+hrwakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_ns < b->wakeup_ns;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -227,6 +633,15 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */                
       timer_sleep (ticks); 
     }
+  else if (clock_is_precise ()
+           && num * NSEC_PER_SEC / denom >= HRSLEEP_MIN_NS)
+    {
+      /* Otherwise, if we can tell time between ticks and the
+         wait is long enough to be worth a context switch, block
+         until the deadline.  timer_hrsleep() programs the timer
+         to wake us then. */
+      timer_hrsleep (num * NSEC_PER_SEC / denom);
+    }
   else 
     {
       /* Otherwise, use a busy-wait loop for more accurate
@@ -242,5 +657,14 @@ real_time_delay (int64_t num, int32_t denom)
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
-  busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
+  if (clock_is_precise ())
+    {
+      /* Spin on the clock, which is exact, rather than counting
+         loops, which is only as good as the calibration. */
+      int64_t end = clock_ns () + num * (NSEC_PER_SEC / 1000) / (denom / 1000);
+      while (clock_ns () < end)
+        barrier ();
+    }
+  else
+    busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
 }
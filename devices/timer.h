@@ -2,11 +2,18 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-/* Number of timer interrupts per second. */
-#define TIMER_FREQ 100
+/* Default number of timer interrupts per second. */
+#define TIMER_FREQ_DEFAULT 100
 
+/* Number of timer interrupts per second.
+   Chosen at boot time with the "-timer-freq" option. */
+#define TIMER_FREQ timer_freq
+extern int timer_freq;
+
+void timer_configure (int freq, bool tickless);
 void timer_init (void);
 void timer_calibrate (void);
 
@@ -18,12 +25,17 @@ void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
+void timer_hrsleep (int64_t nanoseconds);
 
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle. */
+void timer_idle_enter (void);
+int64_t timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -0,0 +1,90 @@
+/* sysbench.c
+
+   Measures the round-trip cost of tiny system calls, entering
+   the kernel through "int $0x30" and through the C library,
+   which uses SYSENTER where the CPU supports it.
+
+   Usage: sysbench [FILE]
+   FILE, which defaults to this program's own executable, must
+   exist; its descriptor is passed to filesize() and tell(). */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "../syscall-nr.h"
+
+/* Number of calls to time for each measurement. */
+#define ITERATIONS 10000
+
+/* Invokes system call NUMBER with argument ARG through
+   "int $0x30", bypassing the C library. */
+static int
+int_syscall1 (int number, int arg) 
+{
+  int retval;
+  asm volatile
+    ("pushl %[arg]; pushl %[number]; int $0x30; addl $8, %%esp"
+     : "=a" (retval)
+     : [number] "r" (number), [arg] "r" (arg)
+     : "memory");
+  return retval;
+}
+
+static uint64_t
+rdtsc (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Returns the average number of cycles per call of system call
+   NUMBER on FD, made through "int $0x30" if USE_INT is true,
+   otherwise through the C library. */
+static unsigned
+measure (int number, int fd, bool use_int) 
+{
+  uint64_t start;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    if (use_int)
+      int_syscall1 (number, fd);
+    else if (number == SYS_FILESIZE)
+      filesize (fd);
+    else
+      tell (fd);
+  return (rdtsc () - start) / ITERATIONS;
+}
+
+/* Prints one line comparing both entry paths for NUMBER. */
+static void
+compare (const char *name, int number, int fd) 
+{
+  unsigned slow = measure (number, fd, true);
+  unsigned fast = measure (number, fd, false);
+
+  printf ("%-8s int $0x30: %6u cycles  library: %6u cycles", 
+          name, slow, fast);
+  if (fast != 0)
+    printf ("  (%u.%02ux)", slow / fast, slow * 100 / fast % 100);
+  printf ("\n");
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  const char *name = argc > 1 ? argv[1] : argv[0];
+  int fd = open (name);
+  if (fd < 0) 
+    {
+      printf ("%s: open failed\n", name);
+      return EXIT_FAILURE;
+    }
+
+  compare ("filesize", SYS_FILESIZE, fd);
+  compare ("tell", SYS_TELL, fd);
+  close (fd);
+  return EXIT_SUCCESS;
+}
@@ -11,6 +11,10 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Next sector to write in the scratch device's ustar archive,
+   for fsutil_append() and fsutil_append_data(). */
+static block_sector_t append_sector;
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -165,8 +169,7 @@ fsutil_extract (char **argv UNUSED)
 void
 fsutil_append (char **argv)
 {
-  static block_sector_t sector = 0;
-
+  block_sector_t sector = append_sector;
   const char *file_name = argv[1];
   void *buffer;
   struct file *src;
@@ -215,8 +218,58 @@ fsutil_append (char **argv)
   memset (buffer, 0, BLOCK_SECTOR_SIZE);
   block_write (dst, sector, buffer);
   block_write (dst, sector, buffer + 1);
+  append_sector = sector;
 
   /* Finish up. */
   file_close (src);
   free (buffer);
 }
+
+/* Appends the SIZE bytes in DATA to the ustar archive on the
+   scratch device as a file named FILE_NAME, continuing from
+   where the last fsutil_append() or fsutil_append_data() left
+   off.  This lets the kernel hand data that is not in the file
+   system, such as traces, back to the `pintos' utility. */
+void
+fsutil_append_data (const char *file_name, const void *data_, size_t size) 
+{
+  const uint8_t *data = data_;
+  void *buffer;
+  struct block *dst;
+
+  /* Allocate buffer. */
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
+
+  /* Open target block device. */
+  dst = block_get_role (BLOCK_SCRATCH);
+  if (dst == NULL)
+    PANIC ("couldn't open scratch device");
+
+  /* Write ustar header to first sector. */
+  if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
+    PANIC ("%s: name too long for ustar format", file_name);
+  block_write (dst, append_sector++, buffer);
+
+  /* Do copy. */
+  while (size > 0) 
+    {
+      size_t chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
+      if (append_sector >= block_size (dst))
+        PANIC ("%s: out of space on scratch device", file_name);
+      memcpy (buffer, data, chunk_size);
+      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
+      block_write (dst, append_sector++, buffer);
+      data += chunk_size;
+      size -= chunk_size;
+    }
+
+  /* Write ustar end-of-archive marker, without advancing past
+     it, as in fsutil_append(). */
+  memset (buffer, 0, BLOCK_SECTOR_SIZE);
+  block_write (dst, append_sector, buffer);
+  block_write (dst, append_sector + 1, buffer);
+
+  free (buffer);
+}
@@ -28,6 +28,7 @@ struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    size_t hint;        /* Where bitmap_scan_and_flip_next() starts. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +69,15 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the index of the least significant 1 bit in X, which
+   must be nonzero.  Compiles to BSF. */
+static inline size_t
+first_one (elem_type x) 
+{
+  ASSERT (x != 0);
+  return __builtin_ctzl (x);
+}
 
 /* Creation and destruction. */
 
@@ -82,6 +92,7 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
+      b->hint = 0;
       b->bits = malloc (byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
@@ -104,6 +115,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->hint = 0;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
   return b;
@@ -292,20 +304,65 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Works a word at a time: each step takes the rest of the
+   current element, flipped if need be so that the bits we want
+   are 1s, and uses BSF to find where the current run of 1s ends
+   and, if it ends inside the element, where the next one
+   begins.  Elements that are entirely 1s or entirely 0s thus
+   take a single step each, and the cost is linear in the number
+   of elements plus the number of runs, not in the number of
+   bits times CNT. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t run_start, i;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  run_start = i = start;
+  while (i < b->bit_cnt && b->bit_cnt - run_start >= cnt)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t ofs = i % ELEM_BITS;
+      size_t avail = ELEM_BITS - ofs;
+      elem_type word = b->bits[elem_idx (i)];
+      size_t ones;
+
+      /* Line up the bits from I onward at bit 0, as 1s where
+         they equal VALUE, and drop any past the end. */
+      if (!value)
+        word = ~word;
+      word >>= ofs;
+      if (avail > b->bit_cnt - i)
+        avail = b->bit_cnt - i;
+      if (avail < ELEM_BITS)
+        word &= ((elem_type) 1 << avail) - 1;
+
+      /* Extend the run by the 1s at the bottom of WORD. */
+      ones = ~word != 0 ? first_one (~word) : ELEM_BITS;
+      if (i + ones - run_start >= cnt)
+        return run_start;
+      if (ones == avail)
+        {
+          i += avail;
+          continue;
+        }
+
+      /* The run ends inside WORD.  Start a new one at the next 1,
+         if any. */
+      word >>= ones;
+      if (word != 0)
+        i += ones + first_one (word);
+      else
+        i += avail;
+      run_start = i;
     }
   return BITMAP_ERROR;
 }
@@ -326,6 +383,26 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
   return idx;
 }
 
+/* Like bitmap_scan_and_flip(), but starts looking where the
+   previous call left off, wrapping around to the start of B if
+   need be ("next fit").  Spreads allocations across B, instead
+   of crowding them at the front, and usually finds free bits
+   without scanning over the ones allocated before. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value) 
+{
+  size_t start = b->hint <= b->bit_cnt ? b->hint : 0;
+  size_t idx = bitmap_scan (b, start, cnt, value);
+  if (idx == BITMAP_ERROR && start > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR) 
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      b->hint = idx + cnt;
+    }
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -0,0 +1,359 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Our red-black trees follow the presentation in [CLRS] chapter
+   13, "Red-Black Trees", except that null pointers stand in for
+   the black sentinel leaves.  Because a null leaf cannot record
+   its own parent, the deletion fix-up tracks the parent of the
+   node being fixed explicitly.
+
+   Invariants:
+
+     1. Every element is either red or black.
+     2. The root is black.
+     3. A red element has no red children.
+     4. Every path from an element down to a null leaf passes
+        through the same number of black elements.
+
+   Together these guarantee that no path from the root to a leaf
+   is more than twice as long as any other, so the height of a
+   tree of N elements is at most 2 lg (N + 1). */
+
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+                          struct rb_elem *parent);
+static void transplant (struct rb_tree *, struct rb_elem *,
+                        struct rb_elem *);
+static struct rb_elem *subtree_min (struct rb_elem *);
+
+/* Returns true if E is red.  Null leaves are black. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Initializes TREE as an empty tree that orders its elements
+   using LESS given auxiliary data AUX. */
+void
+rb_init (struct rb_tree *tree, rb_less_func *less, void *aux)
+{
+  ASSERT (tree != NULL);
+  ASSERT (less != NULL);
+
+  tree->root = NULL;
+  tree->min = NULL;
+  tree->elem_cnt = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts ELEM into TREE, after any elements equal to it. */
+void
+rb_insert (struct rb_tree *tree, struct rb_elem *elem)
+{
+  struct rb_elem *parent = NULL;
+  struct rb_elem **link = &tree->root;
+  bool leftmost = true;
+
+  ASSERT (tree != NULL);
+  ASSERT (elem != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (tree->less (elem, parent, tree->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          leftmost = false;
+        }
+    }
+
+  elem->parent = parent;
+  elem->left = elem->right = NULL;
+  elem->red = true;
+  *link = elem;
+  if (leftmost)
+    tree->min = elem;
+  tree->elem_cnt++;
+
+  insert_fixup (tree, elem);
+}
+
+/* Removes ELEM, which must be in TREE, from TREE. */
+void
+rb_remove (struct rb_tree *tree, struct rb_elem *elem)
+{
+  struct rb_elem *child, *child_parent;
+  bool removed_red;
+
+  ASSERT (tree != NULL);
+  ASSERT (elem != NULL);
+  ASSERT (tree->elem_cnt > 0);
+
+  if (tree->min == elem)
+    tree->min = rb_next (elem);
+
+  if (elem->left == NULL || elem->right == NULL)
+    {
+      /* ELEM has at most one child, which takes its place. */
+      child = elem->left != NULL ? elem->left : elem->right;
+      child_parent = elem->parent;
+      removed_red = elem->red;
+      transplant (tree, elem, child);
+    }
+  else
+    {
+      /* ELEM has two children.  Its successor, which has no
+         left child, moves into ELEM's place and takes on ELEM's
+         color, so the color that disappears from the tree is
+         the successor's. */
+      struct rb_elem *succ = subtree_min (elem->right);
+
+      removed_red = succ->red;
+      child = succ->right;
+      if (succ->parent == elem)
+        child_parent = succ;
+      else
+        {
+          child_parent = succ->parent;
+          transplant (tree, succ, succ->right);
+          succ->right = elem->right;
+          succ->right->parent = succ;
+        }
+      transplant (tree, elem, succ);
+      succ->left = elem->left;
+      succ->left->parent = succ;
+      succ->red = elem->red;
+    }
+  tree->elem_cnt--;
+
+  if (!removed_red)
+    remove_fixup (tree, child, child_parent);
+}
+
+/* Returns TREE's smallest element, or a null pointer if TREE is
+   empty.  Runs in constant time. */
+struct rb_elem *
+rb_min (const struct rb_tree *tree)
+{
+  ASSERT (tree != NULL);
+  return tree->min;
+}
+
+/* Returns the element that follows ELEM in its tree's order, or
+   a null pointer if ELEM is the largest element. */
+struct rb_elem *
+rb_next (struct rb_elem *elem)
+{
+  ASSERT (elem != NULL);
+
+  if (elem->right != NULL)
+    return subtree_min (elem->right);
+  while (elem->parent != NULL && elem == elem->parent->right)
+    elem = elem->parent;
+  return elem->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t
+rb_size (const struct rb_tree *tree)
+{
+  ASSERT (tree != NULL);
+  return tree->elem_cnt;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *tree)
+{
+  ASSERT (tree != NULL);
+  return tree->root == NULL;
+}
+
+/* Restores the red-black invariants after ELEM, which is red,
+   has been inserted into TREE. */
+static void
+insert_fixup (struct rb_tree *tree, struct rb_elem *elem)
+{
+  while (is_red (elem->parent))
+    {
+      struct rb_elem *parent = elem->parent;
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_elem *uncle = grandparent->right;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              elem = grandparent;
+              continue;
+            }
+          if (elem == parent->right)
+            {
+              elem = parent;
+              rotate_left (tree, elem);
+              parent = elem->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (tree, grandparent);
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              elem = grandparent;
+              continue;
+            }
+          if (elem == parent->left)
+            {
+              elem = parent;
+              rotate_right (tree, elem);
+              parent = elem->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (tree, grandparent);
+        }
+    }
+  tree->root->red = false;
+}
+
+/* Restores the red-black invariants after a black element has
+   been removed from TREE.  ELEM, which may be null, is the
+   element that took the removed element's place, and PARENT is
+   ELEM's parent. */
+static void
+remove_fixup (struct rb_tree *tree, struct rb_elem *elem,
+              struct rb_elem *parent)
+{
+  while (elem != tree->root && !is_red (elem))
+    {
+      if (elem == parent->left)
+        {
+          struct rb_elem *sibling = parent->right;
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (tree, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              elem = parent;
+              parent = elem->parent;
+              continue;
+            }
+          if (!is_red (sibling->right))
+            {
+              sibling->left->red = false;
+              sibling->red = true;
+              rotate_right (tree, sibling);
+              sibling = parent->right;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->right->red = false;
+          rotate_left (tree, parent);
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (tree, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              elem = parent;
+              parent = elem->parent;
+              continue;
+            }
+          if (!is_red (sibling->left))
+            {
+              sibling->right->red = false;
+              sibling->red = true;
+              rotate_left (tree, sibling);
+              sibling = parent->left;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->left->red = false;
+          rotate_right (tree, parent);
+        }
+      elem = tree->root;
+    }
+  if (elem != NULL)
+    elem->red = false;
+}
+
+/* Makes ELEM's right child take ELEM's place in TREE, with ELEM
+   as its left child. */
+static void
+rotate_left (struct rb_tree *tree, struct rb_elem *elem)
+{
+  struct rb_elem *right = elem->right;
+
+  elem->right = right->left;
+  if (right->left != NULL)
+    right->left->parent = elem;
+  transplant (tree, elem, right);
+  right->left = elem;
+  elem->parent = right;
+}
+
+/* Makes ELEM's left child take ELEM's place in TREE, with ELEM
+   as its right child. */
+static void
+rotate_right (struct rb_tree *tree, struct rb_elem *elem)
+{
+  struct rb_elem *left = elem->left;
+
+  elem->left = left->right;
+  if (left->right != NULL)
+    left->right->parent = elem;
+  transplant (tree, elem, left);
+  left->right = elem;
+  elem->parent = left;
+}
+
+/* Replaces the subtree rooted at OLD in TREE by the subtree
+   rooted at NEW, which may be null.  OLD's children are not
+   changed. */
+static void
+transplant (struct rb_tree *tree, struct rb_elem *old, struct rb_elem *new)
+{
+  if (old->parent == NULL)
+    tree->root = new;
+  else if (old == old->parent->left)
+    old->parent->left = new;
+  else
+    old->parent->right = new;
+  if (new != NULL)
+    new->parent = old->parent;
+}
+
+/* Returns the smallest element in the subtree rooted at ELEM. */
+static struct rb_elem *
+subtree_min (struct rb_elem *elem)
+{
+  while (elem->left != NULL)
+    elem = elem->left;
+  return elem;
+}
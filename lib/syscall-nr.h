@@ -28,7 +28,10 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Real-time scheduling. */
+    SYS_SCHED_DEADLINE          /* Join or leave the real-time class. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -1,31 +1,75 @@
 #include <syscall.h>
 #include "../syscall-nr.h"
 
+/* System calls enter the kernel through SYSENTER if the CPU
+   supports it, which is much cheaper than "int $0x30".  Either
+   way, the call number and arguments are on the stack.  For
+   SYSENTER, we also pass the stack pointer in ECX and the return
+   address in EDX; SYSEXIT restores them from there.
+
+   SYSENTER_OK is 1 if SYSENTER may be used, 0 if not, and -1
+   until we find out. */
+static signed char sysenter_ok = -1;
+
+/* Sets SYSENTER_OK according to CPUID. */
+static void
+probe_sysenter (void) 
+{
+  unsigned int eax, ebx, ecx, edx;
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1), "c" (0));
+  sysenter_ok = (edx & (1 << 11)) != 0;
+}
+
+/* Traps into the kernel with the system call number and
+   arguments already pushed, then discards ARGS_SIZE bytes of
+   them. */
+#define SYSCALL_TRAP(ARGS_SIZE)                                 \
+        "cmpb $0, %[ok]; je 2f; "                               \
+        "movl %%esp, %%ecx; movl $1f, %%edx; sysenter; "        \
+        "2: int $0x30; "                                        \
+        "1: addl $" #ARGS_SIZE ", %%esp"
+
+/* Probes for SYSENTER support on the first system call. */
+#define SYSCALL_PROBE()                                         \
+        do                                                      \
+          {                                                     \
+            if (sysenter_ok < 0)                                \
+              probe_sysenter ();                                \
+          }                                                     \
+        while (0)
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
+          SYSCALL_PROBE ();                                     \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; " SYSCALL_TRAP (4)               \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : [number] "i" (NUMBER),                         \
+                 [ok] "m" (sysenter_ok)                         \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing argument ARG0, and returns the
    return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
-        ({                                                               \
-          int retval;                                                    \
-          asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-               : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
-          retval;                                                        \
+#define syscall1(NUMBER, ARG0)                                  \
+        ({                                                      \
+          int retval;                                           \
+          SYSCALL_PROBE ();                                     \
+          asm volatile                                          \
+            ("pushl %[arg0]; pushl %[number]; "                 \
+             SYSCALL_TRAP (8)                                   \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [ok] "m" (sysenter_ok),                        \
+                 [arg0] "g" (ARG0)                              \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
@@ -33,14 +77,16 @@
 #define syscall2(NUMBER, ARG0, ARG1)                            \
         ({                                                      \
           int retval;                                           \
+          SYSCALL_PROBE ();                                     \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; " SYSCALL_TRAP (12)              \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
+                 [ok] "m" (sysenter_ok),                        \
                  [arg0] "g" (ARG0),                             \
                  [arg1] "g" (ARG1)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -49,15 +95,17 @@
 #define syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
         ({                                                      \
           int retval;                                           \
+          SYSCALL_PROBE ();                                     \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; " SYSCALL_TRAP (16)              \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
+                 [ok] "m" (sysenter_ok),                        \
                  [arg0] "g" (ARG0),                             \
                  [arg1] "g" (ARG1),                             \
                  [arg2] "g" (ARG2)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -182,3 +230,9 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+sched_deadline (int period_ms, int runtime_ms, int deadline_ms) 
+{
+  return syscall3 (SYS_SCHED_DEADLINE, period_ms, runtime_ms, deadline_ms);
+}
@@ -45,4 +45,7 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Real-time scheduling. */
+bool sched_deadline (int period_ms, int runtime_ms, int deadline_ms);
+
 #endif /* lib/user/syscall.h */
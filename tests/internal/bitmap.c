@@ -0,0 +1,107 @@
+/* Test program and microbenchmark for bitmap_scan() in
+   lib/kernel/bitmap.c.
+
+   Builds fragmented bitmaps, like a well-used free map, checks
+   that bitmap_scan() agrees with a straightforward bit-by-bit
+   scan for runs of various lengths, and prints how many cycles
+   each takes.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/test.h"
+
+/* Number of bits in each bitmap, as in an 8 MB disk's free map. */
+#define BIT_CNT 16384
+
+/* Percentages of bits to set. */
+static const int densities[] = {10, 50, 90, 99};
+
+/* Run lengths to look for. */
+static const size_t run_lengths[] = {1, 8, 64};
+
+static size_t naive_scan (const struct bitmap *, size_t start, size_t cnt,
+                          bool value);
+static void fragment (struct bitmap *, int density);
+
+void
+test (void) 
+{
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  size_t i, j;
+
+  ASSERT (b != NULL);
+  random_init (0);
+
+  for (i = 0; i < sizeof densities / sizeof *densities; i++) 
+    {
+      fragment (b, densities[i]);
+      for (j = 0; j < sizeof run_lengths / sizeof *run_lengths; j++) 
+        {
+          size_t cnt = run_lengths[j];
+          uint64_t start, naive_cycles, fast_cycles;
+          size_t naive_idx = 0, fast_idx = 0, ofs;
+
+          start = rdtsc ();
+          for (ofs = 0; ofs < BIT_CNT; ofs += BIT_CNT / 16)
+            naive_idx += naive_scan (b, ofs, cnt, false);
+          naive_cycles = rdtsc () - start;
+
+          start = rdtsc ();
+          for (ofs = 0; ofs < BIT_CNT; ofs += BIT_CNT / 16)
+            fast_idx += bitmap_scan (b, ofs, cnt, false);
+          fast_cycles = rdtsc () - start;
+
+          ASSERT (naive_idx == fast_idx);
+          printf ("%2d%% full, runs of %2zu: bit by bit %8"PRIu64
+                  " cycles, word at a time %8"PRIu64" cycles\n",
+                  densities[i], cnt, naive_cycles / 16, fast_cycles / 16);
+        }
+    }
+  bitmap_destroy (b);
+  printf ("done\n");
+}
+
+/* The original bitmap_scan(), which tries every starting index
+   in turn. */
+static size_t
+naive_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  if (cnt <= bitmap_size (b)) 
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i;
+      for (i = start; i <= last; i++)
+        if (!bitmap_contains (b, i, cnt, !value))
+          return i; 
+    }
+  return BITMAP_ERROR;
+}
+
+/* Sets about DENSITY percent of B's bits, in runs of random
+   length, and clears the rest. */
+static void
+fragment (struct bitmap *b, int density) 
+{
+  size_t i = 0;
+
+  bitmap_set_all (b, false);
+  while (i < bitmap_size (b)) 
+    {
+      size_t len = random_ulong () % 32 + 1;
+      bool value = (int) (random_ulong () % 100) < density;
+
+      if (len > bitmap_size (b) - i)
+        len = bitmap_size (b) - i;
+      bitmap_set_multiple (b, i, len, value);
+      i += len;
+    }
+}
@@ -0,0 +1,92 @@
+/* Microbenchmark for global kernel mappings.
+
+   Measures what an address-space switch costs the kernel: we
+   alternate between two page directories, as switching between
+   two user processes would, and after each switch touch a set of
+   kernel pages spread over the kernel pool.  With CR4.PGE set,
+   the kernel's translations stay in the TLB across the CR3
+   reload; with it clear, each touch after a switch is a TLB
+   miss.  Runs both ways, if the CPU supports global pages, and
+   prints the cycles per switch.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "userprog/pagedir.h"
+
+/* Number of kernel pages to touch after each switch. */
+#define PAGE_CNT 64
+
+/* Number of switches to time. */
+#define SWITCH_CNT 10000
+
+static uint64_t measure (uint32_t *pd[2], volatile char *pages[]);
+
+void
+test (void) 
+{
+  volatile char *pages[PAGE_CNT];
+  uint32_t *pd[2];
+  bool pge = cpu_has (CPUID_PGE);
+  uint32_t cr4;
+  int i;
+
+  for (i = 0; i < PAGE_CNT; i++) 
+    pages[i] = palloc_get_page (PAL_ASSERT);
+  pd[0] = pagedir_create ();
+  pd[1] = pagedir_create ();
+  ASSERT (pd[0] != NULL && pd[1] != NULL);
+
+  cr4 = read_cr4 ();
+  if (pge)
+    {
+      write_cr4 (cr4 & ~CR4_PGE);
+      printf ("without global pages: %"PRIu64" cycles per switch\n",
+              measure (pd, pages));
+      write_cr4 (cr4 | CR4_PGE);
+      printf ("with global pages: %"PRIu64" cycles per switch\n",
+              measure (pd, pages));
+    }
+  else
+    printf ("no global pages: %"PRIu64" cycles per switch\n",
+            measure (pd, pages));
+  write_cr4 (cr4);
+
+  pagedir_activate (NULL);
+  pagedir_destroy (pd[0]);
+  pagedir_destroy (pd[1]);
+  for (i = 0; i < PAGE_CNT; i++) 
+    palloc_free_page ((void *) pages[i]);
+}
+
+/* Returns the average number of cycles to switch to one of the
+   page directories in PD and then touch each of PAGES. */
+static uint64_t
+measure (uint32_t *pd[2], volatile char *pages[]) 
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t start = rdtsc ();
+  int i, j;
+
+  for (i = 0; i < SWITCH_CNT; i++) 
+    {
+      pagedir_activate (pd[i % 2]);
+      for (j = 0; j < PAGE_CNT; j++)
+        pages[j][0];
+    }
+  start = rdtsc () - start;
+
+  pagedir_activate (NULL);
+  intr_set_level (old_level);
+  return start / SWITCH_CNT;
+}
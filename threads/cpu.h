@@ -0,0 +1,84 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Processor identification and model-specific instructions.
+   See [IA32-v2a] "CPUID" and [IA32-v2b] "RDTSC". */
+
+/* CPUID leaf 1 feature flags, returned in EDX. */
+#define CPUID_FPU 0x00000001    /* x87 floating-point unit. */
+#define CPUID_PSE 0x00000008    /* 4 MB pages. */
+#define CPUID_TSC 0x00000010    /* Time stamp counter. */
+#define CPUID_SEP 0x00000800    /* SYSENTER and SYSEXIT instructions. */
+#define CPUID_PGE 0x00002000    /* Global pages. */
+#define CPUID_FXSR 0x01000000   /* FXSAVE and FXRSTOR instructions. */
+#define CPUID_SSE 0x02000000    /* Streaming SIMD extensions. */
+
+/* Executes CPUID with EAX set to LEAF and stores the resulting
+   EAX, EBX, ECX, and EDX into REGS[0] through REGS[3]. */
+static inline void
+cpuid (uint32_t leaf, uint32_t regs[4])
+{
+  asm volatile ("cpuid"
+                : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]),
+                  "=d" (regs[3])
+                : "a" (leaf), "c" (0));
+}
+
+/* Returns true if the CPU reports all of the CPUID leaf 1 EDX
+   feature flags in FEATURES. */
+static inline bool
+cpu_has (uint32_t features)
+{
+  uint32_t regs[4];
+  cpuid (1, regs);
+  return (regs[3] & features) == features;
+}
+
+/* CR4 bits. */
+#define CR4_PSE 0x00000010        /* 4 MB pages. */
+#define CR4_PGE 0x00000080        /* Global pages. */
+#define CR4_OSFXSR 0x00000200     /* FXSAVE/FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* #XF for unmasked SSE errors. */
+
+/* Returns the contents of control register CR4. */
+static inline uint32_t
+read_cr4 (void)
+{
+  uint32_t cr4;
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  return cr4;
+}
+
+/* Sets control register CR4 to CR4. */
+static inline void
+write_cr4 (uint32_t cr4)
+{
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+}
+
+/* Model-specific registers. */
+#define MSR_SYSENTER_CS 0x174   /* SYSENTER code segment. */
+#define MSR_SYSENTER_ESP 0x175  /* SYSENTER stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* SYSENTER entry point. */
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* Returns the processor's time stamp counter, which counts
+   processor clock cycles since reset. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/cpu.h */
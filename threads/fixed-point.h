@@ -0,0 +1,74 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Fixed-point real arithmetic.
+
+   The kernel does not use floating point, so the multi-level
+   feedback queue scheduler represents real quantities such as
+   load_avg and recent_cpu in 17.14 fixed-point format: a
+   fixed_t X represents the real number X / FP_F.  The top bit
+   is the sign, the next 17 bits the integer part, and the low
+   14 bits the fraction, so the largest representable value is
+   about 131,071.999.
+
+   Multiplication and division of two fixed-point values go
+   through 64-bit intermediates to avoid overflow. */
+
+/* A fixed-point number. */
+typedef int32_t fixed_t;
+
+#define FP_Q 14                         /* Number of fraction bits. */
+#define FP_F (1 << FP_Q)                /* Fixed-point 1.0. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t
+fp_from_int (int n)
+{
+  return n * FP_F;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_to_int (fixed_t x)
+{
+  return x / FP_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_t x)
+{
+  return x >= 0 ? (x + FP_F / 2) / FP_F : (x - FP_F / 2) / FP_F;
+}
+
+/* Returns X + N, where N is an integer. */
+static inline fixed_t
+fp_add_int (fixed_t x, int n)
+{
+  return x + n * FP_F;
+}
+
+/* Returns X - N, where N is an integer. */
+static inline fixed_t
+fp_sub_int (fixed_t x, int n)
+{
+  return x - n * FP_F;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fp_mul (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * y / FP_F;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fp_div (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * FP_F / y;
+}
+
+#endif /* threads/fixed-point.h */
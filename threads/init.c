@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "devices/clock.h"
 #include "devices/kbd.h"
 #include "devices/input.h"
 #include "devices/serial.h"
@@ -15,13 +16,17 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef VM
 #include "vm/frame.h"
 #include "vm/page.h"
@@ -61,12 +66,23 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -zero-pages: Number of pre-zeroed pages the idle thread keeps
+   in each of palloc's pools. */
+static size_t zeroed_page_target = 64;
+
+/* -timer-freq, -notickless: Timer interrupt frequency and
+   whether to stop the periodic timer while idle. */
+static int timer_freq_option = TIMER_FREQ_DEFAULT;
+static bool tickless_option = true;
+
 static void bss_init (void);
 static void paging_init (void);
+static bool large_page_ok (size_t page);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
+static void parse_sched (const char *value);
 static void usage (void);
 
 #ifdef FILESYS
@@ -99,10 +115,13 @@ main (void)
           init_ram_pages * PGSIZE / 1024);
 
   /* Initialize memory system. */
-  palloc_init (user_page_limit);
+  palloc_init (user_page_limit, zeroed_page_target);
   malloc_init ();
   paging_init ();
-  frame_init();
+#ifdef VM
+  frame_init ();
+  page_sup_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -112,6 +131,7 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  timer_configure (timer_freq_option, tickless_option);
   timer_init ();
   kbd_init ();
   input_init ();
@@ -124,6 +144,8 @@ main (void)
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+  clock_init ();
+  workqueue_init ();
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -142,6 +164,24 @@ main (void)
   thread_exit ();
 }
 
+/* Returns true if the 4 MB of RAM starting at page PAGE may be
+   mapped with a single 4 MB page.  It must lie entirely within
+   RAM and may not include kernel text, which must be mapped
+   read-only page by page.  Nor may it include the user pool:
+   the frame table reads the accessed and dirty bits of user
+   frames through their 4 kB kernel mappings. */
+static bool
+large_page_ok (size_t page) 
+{
+  extern char _start, _end_kernel_text;
+  char *start = ptov (page * PGSIZE);
+  char *end = start + PTSPAN;
+
+  return (page + PTSPAN / PGSIZE <= init_ram_pages
+          && (end <= &_start || start >= &_end_kernel_text)
+          && end <= (char *) palloc_user_start ());
+}
+
 /* Clear the "BSS", a segment that should be initialized to
    zeros.  It isn't actually stored on disk or zeroed by the
    kernel loader, so we have to zero it ourselves.
@@ -158,12 +198,24 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Where the CPU supports it, the kernel mapping is marked
+   global.  Every page directory copies these PDEs (see
+   pagedir_create()), so the kernel's translations are the same
+   in every address space and need not be flushed from the TLB
+   when CR3 is reloaded on a process switch.
+
+   Also where the CPU supports it, each 4 MB of RAM that
+   large_page_ok() allows is mapped by a single PDE, saving a
+   page table and 1,023 TLB entries. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  bool global = cpu_has (CPUID_PGE);
+  bool pse = cpu_has (CPUID_PSE);
   extern char _start, _end_kernel_text;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -179,19 +231,39 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
+          if (pse && large_page_ok (page))
+            {
+              pd[pde_idx] = pde_create_large (vaddr, true);
+              if (global)
+                pd[pde_idx] |= PTE_G;
+              page += PTSPAN / PGSIZE - 1;
+              continue;
+            }
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      if (global)
+        pt[pte_idx] |= PTE_G;
     }
 
+  /* 4 MB pages must be turned on before they are used.  See
+     [IA32-v3a] 3.6.1 "Paging Options". */
+  if (pse)
+    write_cr4 (read_cr4 () | CR4_PSE);
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Turn on global pages by setting CR4.PGE.  See [IA32-v3a]
+     3.12 "Translation Lookaside Buffers (TLBs)". */
+  if (global)
+    write_cr4 (read_cr4 () | CR4_PGE);
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -262,6 +334,16 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-sched"))
+        parse_sched (value);
+      else if (!strcmp (name, "-timer-freq"))
+        timer_freq_option = atoi (value);
+      else if (!strcmp (name, "-notickless"))
+        tickless_option = false;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
+      else if (!strcmp (name, "-zero-pages"))
+        zeroed_page_target = atoi (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -283,6 +365,24 @@ parse_options (char **argv)
   return argv;
 }
 
+/* Selects the thread scheduler named VALUE, for the -sched
+   option. */
+static void
+parse_sched (const char *value)
+{
+  thread_mlfqs = thread_cfs = false;
+  if (value == NULL)
+    PANIC ("option `-sched' requires a scheduler name");
+  else if (!strcmp (value, "rr"))
+    ;
+  else if (!strcmp (value, "mlfqs"))
+    thread_mlfqs = true;
+  else if (!strcmp (value, "cfs"))
+    thread_cfs = true;
+  else
+    PANIC ("unknown scheduler `%s' (use -h for help)", value);
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -315,12 +415,14 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"profile", 1, profile_dump},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"sched-trace", 1, trace_dump},
 #endif
       {NULL, 0, NULL},
     };
@@ -363,6 +465,7 @@ usage (void)
 #else
           "  run TEST           Run TEST.\n"
 #endif
+          "  profile            Print profile taken with -profile.\n"
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
@@ -370,6 +473,7 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "  sched-trace        Append scheduler trace to scratch device.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -385,6 +489,12 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -sched=SCHED       Use SCHED scheduler: rr (round-robin, the\n"
+          "                     default), mlfqs, or cfs (completely fair).\n"
+          "  -timer-freq=HZ     Take HZ timer interrupts per second (19...1000).\n"
+          "  -notickless        Keep the timer interrupting while idle.\n"
+          "  -profile           Sample call stacks on each timer interrupt.\n"
+          "  -zero-pages=COUNT  Keep COUNT pre-zeroed pages per pool (def. 64).\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
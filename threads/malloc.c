@@ -11,11 +11,14 @@
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   The size of each request, in bytes, is rounded up to the next
+   size class and assigned to the "descriptor" that manages
+   blocks of that size.  There are four size classes per power of
+   2 (16, 20, 24, 28, 32, 40, ...), so that a block wastes at most
+   about 20% of its size rather than up to half, and a table maps
+   each request size directly to its descriptor.  The descriptor
+   keeps a list of free blocks.  If the free list is nonempty,
+   one of its blocks is used to satisfy the request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
@@ -32,7 +35,11 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   realloc() resizes a block in place when it can: when the new
+   size still fits in the block, or, for a big block, when the
+   pages that follow it are free. */
 
 /* Descriptor. */
 struct desc
@@ -41,8 +48,26 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+
+    /* Statistics, protected by LOCK. */
+    size_t arena_cnt;           /* Number of arenas. */
+    size_t in_use;              /* Number of blocks allocated. */
+    unsigned long long alloc_cnt; /* Number of allocations ever. */
+    unsigned long long req_bytes; /* Bytes requested by those. */
   };
 
+/* Smallest block size.  Blocks must hold a struct block. */
+#define MIN_BLOCK 16
+
+/* Size classes per power of 2. */
+#define CLASS_STEPS 4
+
+/* Largest block size that a descriptor handles. */
+#define MAX_BLOCK (PGSIZE / 2 - 1)
+
+/* Request sizes are looked up in units of this many bytes. */
+#define SIZE_UNIT 4
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -61,26 +86,56 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[32];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Maps a request of SIZE bytes to the index in DESCS of the
+   smallest descriptor that can satisfy it, through
+   size_to_desc[DIV_ROUND_UP (SIZE, SIZE_UNIT)]. */
+static uint8_t size_to_desc[MAX_BLOCK / SIZE_UNIT + 1];
+
+/* Big block statistics. */
+static unsigned long long big_alloc_cnt; /* Big blocks allocated. */
+static unsigned long long big_grow_cnt;  /* Reallocs grown in place. */
+
 static struct arena *block_to_arena (struct block *);
+static bool resize_in_place (void *, size_t);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
-  size_t block_size;
-
-  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+  size_t power, step, unit;
+
+  /* Create descriptors for the size classes between each power
+     of 2 and the next. */
+  for (power = MIN_BLOCK; power <= MAX_BLOCK; power *= 2)
+    for (step = 0; step < CLASS_STEPS; step++)
+      {
+        size_t block_size = power + power / CLASS_STEPS * step;
+        struct desc *d;
+
+        if (block_size > MAX_BLOCK)
+          break;
+        d = &descs[desc_cnt++];
+        ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+        d->block_size = block_size;
+        d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+        list_init (&d->free_list);
+        lock_init (&d->lock);
+        lock_set_name (&d->lock, "malloc");
+      }
+
+  /* Fill in the lookup table. */
+  for (unit = 0, step = 0;
+       unit < sizeof size_to_desc
+         && unit * SIZE_UNIT <= descs[desc_cnt - 1].block_size;
+       unit++)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      while (descs[step].block_size < unit * SIZE_UNIT)
+        step++;
+      size_to_desc[unit] = step;
     }
 }
 
@@ -99,10 +154,7 @@ malloc (size_t size)
 
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
+  if (size > descs[desc_cnt - 1].block_size) 
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
@@ -116,8 +168,11 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      big_alloc_cnt++;
       return a + 1;
     }
+  d = &descs[size_to_desc[DIV_ROUND_UP (size, SIZE_UNIT)]];
+  ASSERT (d->block_size >= size);
 
   lock_acquire (&d->lock);
 
@@ -138,6 +193,7 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      d->arena_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
@@ -149,6 +205,9 @@ malloc (size_t size)
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+  d->in_use++;
+  d->alloc_cnt++;
+  d->req_bytes += size;
   lock_release (&d->lock);
   return b;
 }
@@ -199,6 +258,8 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    return old_block;
   else 
     {
       void *new_block = malloc (new_size);
@@ -237,6 +298,7 @@ free (void *p)
 
           /* Add block to free list. */
           list_push_front (&d->free_list, &b->free_elem);
+          d->in_use--;
 
           /* If the arena is now entirely unused, free it. */
           if (++a->free_cnt >= d->blocks_per_arena) 
@@ -250,6 +312,7 @@ free (void *p)
                   list_remove (&b->free_elem);
                 }
               palloc_free_page (a);
+              d->arena_cnt--;
             }
 
           lock_release (&d->lock);
@@ -263,6 +326,60 @@ free (void *p)
     }
 }
 
+/* Prints statistics for each size class in use: arenas, blocks
+   in use, and the share of the bytes handed out by all
+   allocations so far that was slack, rounding up to the class
+   size. */
+void
+malloc_print_stats (void) 
+{
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++) 
+    {
+      struct desc *d = &descs[i];
+      unsigned long long given;
+      unsigned slack;
+
+      if (d->alloc_cnt == 0)
+        continue;
+      given = d->alloc_cnt * d->block_size;
+      slack = (given - d->req_bytes) * 1000 / given;
+      printf ("Malloc: %4zu-byte class: %zu arenas, %zu in use, "
+              "%llu allocs, %u.%u%% slack\n",
+              d->block_size, d->arena_cnt, d->in_use, d->alloc_cnt,
+              slack / 10, slack % 10);
+    }
+  printf ("Malloc: %llu big blocks, %llu grown in place\n",
+          big_alloc_cnt, big_grow_cnt);
+}
+
+/* Tries to resize BLOCK to NEW_SIZE bytes without moving it.
+   Returns true if successful, false if BLOCK must move. */
+static bool
+resize_in_place (void *block, size_t new_size) 
+{
+  struct arena *a = block_to_arena (block);
+  size_t page_cnt;
+
+  /* Fits in the slack of the block as allocated. */
+  if (new_size <= block_size (block))
+    return true;
+
+  /* A big block can grow into the pages that follow it. */
+  if (a->desc == NULL)
+    {
+      page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+      if (palloc_grow (a, a->free_cnt, page_cnt))
+        {
+          a->free_cnt = page_cnt;
+          big_grow_cnt++;
+          return true;
+        }
+    }
+  return false;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -1,14 +1,14 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -25,25 +25,95 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
+/* Each pool is managed as a binary buddy system.  A free block
+   of order K is 2**K pages, starting at a page index within the
+   pool that is a multiple of 2**K.  Its "buddy" is the block of
+   the same order it was split from, at index ^ 2**K.  Allocating
+   takes the smallest free block large enough, splitting it in
+   halves as needed; freeing merges a block with its buddy for
+   as long as the buddy is free too.  Both take time logarithmic
+   in the pool size.
+
+   A request for a number of pages that is not a power of 2 is
+   rounded up to a block, and the pages beyond the request are
+   freed again at once, so they are not wasted.  A request for
+   more pages than the largest block fails.
+
+   The free blocks of each order are kept in a list, linked
+   through the blocks' own first pages.  One byte of state per
+   page, stored at the base of the pool, records whether the page
+   starts a free block and of what order.
+
+   The free lists are protected by turning interrupts off rather
+   than by a lock.  Pages are freed from inside the scheduler,
+   when thread_schedule_tail() releases a dying thread's page,
+   where blocking on a lock is not allowed.  Every operation
+   touches only a logarithmic number of blocks, so the time spent
+   with interrupts off is short.
+
+   Separately, each pool keeps a list of single free pages that
+   are already filled with zeros, so that most PAL_ZERO requests
+   for one page need not clear it.  The idle thread fills the
+   list up to a target length by taking order-0 blocks from the
+   buddy system and zeroing them; see palloc_idle_zero().  Pages
+   on the list count as allocated to the buddy system, so when a
+   request cannot otherwise be satisfied the list is given back
+   first. */
+
+/* Number of block orders.  The largest block is 2**(ORDER_CNT -
+   1) pages, that is, 4 MB. */
+#define ORDER_CNT 11
+
+/* Page state: set if a page is the first page of a free block,
+   in which case the low bits give the block's order. */
+#define STATE_FREE 0x80
+#define STATE_ORDER 0x7f
+
+/* Returned by alloc_block() on failure. */
+#define NO_BLOCK SIZE_MAX
+
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *state;                     /* Per-page state. */
+    size_t page_cnt;                    /* Number of pages. */
     uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* Name, for statistics. */
+    struct list free[ORDER_CNT];        /* Free blocks of each order. */
+    size_t free_cnt[ORDER_CNT];         /* Length of each free list. */
+
+    /* Pre-zeroed pages. */
+    struct list zeroed;                 /* Zeroed free pages. */
+    size_t zeroed_cnt;                  /* Length of zeroed. */
+    size_t zero_hits;                   /* PAL_ZERO requests from zeroed. */
+    size_t zero_misses;                 /* PAL_ZERO requests cleared now. */
+    size_t idle_zeroed;                 /* Pages zeroed by idle thread. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Number of zeroed pages the idle thread keeps in each pool. */
+static size_t zeroed_target;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static struct list_elem *block_elem (const struct pool *, size_t page_idx);
+static size_t block_idx (const struct pool *, struct list_elem *);
+static size_t alloc_block (struct pool *, int order);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t free_block_at (const struct pool *, size_t page_idx, int *order);
+static void release_zeroed (struct pool *);
+static bool zero_one_page (struct pool *);
+static void print_pool_stats (const struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
-   pages are put into the user pool. */
+   pages are put into the user pool.  The idle thread keeps up to
+   ZEROED_PAGE_TARGET pre-zeroed pages in each pool. */
 void
-palloc_init (size_t user_page_limit)
+palloc_init (size_t user_page_limit, size_t zeroed_page_target)
 {
   /* Free memory starts at 1 MB and runs to the end of RAM. */
   uint8_t *free_start = ptov (1024 * 1024);
@@ -59,6 +129,7 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+  zeroed_target = zeroed_page_target;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -71,17 +142,54 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
+  int order;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  /* Find the smallest order that holds PAGE_CNT pages. */
+  for (order = 0; (size_t) 1 << order < page_cnt; order++)
+    if (order == ORDER_CNT - 1)
+      {
+        order = ORDER_CNT;
+        break;
+      }
 
-  if (page_idx != BITMAP_ERROR)
+  page_idx = NO_BLOCK;
+  if (order < ORDER_CNT)
+    {
+      old_level = intr_disable ();
+      if ((flags & PAL_ZERO) && page_cnt == 1 && pool->zeroed_cnt > 0)
+        {
+          /* Only the list link needs clearing. */
+          struct list_elem *e = list_pop_front (&pool->zeroed);
+          pool->zeroed_cnt--;
+          pool->zero_hits++;
+          memset (e, 0, sizeof *e);
+          flags &= ~PAL_ZERO;
+          page_idx = block_idx (pool, e);
+        }
+      else
+        {
+          page_idx = alloc_block (pool, order);
+          if (page_idx == NO_BLOCK && pool->zeroed_cnt > 0)
+            {
+              release_zeroed (pool);
+              page_idx = alloc_block (pool, order);
+            }
+          if (page_idx != NO_BLOCK)
+            free_range (pool, page_idx + page_cnt,
+                        ((size_t) 1 << order) - page_cnt);
+          if (flags & PAL_ZERO)
+            pool->zero_misses++;
+        }
+      intr_set_level (old_level);
+    }
+
+  if (page_idx != NO_BLOCK)
     pages = pool->base + PGSIZE * page_idx;
   else
     pages = NULL;
@@ -117,6 +225,7 @@ palloc_get_page (enum palloc_flags flags)
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
+  enum intr_level old_level;
   struct pool *pool;
   size_t page_idx;
 
@@ -137,8 +246,75 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  free_range (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
+}
+
+/* Tries to extend the allocation of PAGE_CNT pages at PAGES,
+   which must have come from palloc_get_multiple(), to NEW_CNT
+   pages without moving it.  Returns true if successful, in
+   which case the allocation must later be freed as NEW_CNT
+   pages.  Returns false, changing nothing, if any of the pages
+   that follow are in use or beyond the end of the pool. */
+bool
+palloc_grow (void *pages, size_t page_cnt, size_t new_cnt) 
+{
+  enum intr_level old_level;
+  struct pool *pool;
+  size_t start, end, page_idx;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  start = pg_no (pages) - pg_no (pool->base) + page_cnt;
+  end = start + (new_cnt - page_cnt);
+  if (end > pool->page_cnt)
+    return false;
+
+  old_level = intr_disable ();
+
+  /* Check that every page is free before changing anything. */
+  for (page_idx = start; page_idx < end; )
+    {
+      int order = 0;
+      size_t head = free_block_at (pool, page_idx, &order);
+      if (head == NO_BLOCK)
+        {
+          intr_set_level (old_level);
+          return false;
+        }
+      page_idx = head + ((size_t) 1 << order);
+    }
+
+  /* Take each free block that overlaps the range, and give back
+     the parts of it outside the range. */
+  for (page_idx = start; page_idx < end; )
+    {
+      int order = 0;
+      size_t head = free_block_at (pool, page_idx, &order);
+      size_t block_end = head + ((size_t) 1 << order);
+
+      ASSERT (head != NO_BLOCK);
+
+      list_remove (block_elem (pool, head));
+      pool->free_cnt[order]--;
+      pool->state[head] = 0;
+      free_range (pool, head, page_idx - head);
+      if (block_end > end)
+        free_range (pool, end, block_end - end);
+      page_idx = block_end;
+    }
+
+  intr_set_level (old_level);
+  return true;
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +324,67 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page and adds it to its pool's list of zeroed
+   pages, if either pool has fewer than the target number.
+   Returns true if it did, false if there was nothing to do or
+   the work could not be done without waiting.  Called
+   repeatedly by the idle thread, so it never blocks and does
+   only one page of work per call. */
+bool
+palloc_idle_zero (void) 
+{
+  return zero_one_page (&kernel_pool) || zero_one_page (&user_pool);
+}
+
+/* Returns the kernel virtual address where the user pool
+   begins.  The user pool runs from there to the end of RAM. */
+void *
+palloc_user_start (void) 
+{
+  return user_pool.base;
+}
+
+/* Prints the number of free blocks of each order in each
+   pool. */
+void
+palloc_print_stats (void) 
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's page state at its base.
+     Calculate the space needed for it
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t state_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  int order;
+
+  if (state_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page state.", name);
+  page_cnt -= state_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  /* Initialize the pool, with every page free. */
+  p->state = base;
+  memset (p->state, 0, page_cnt);
+  p->page_cnt = page_cnt;
+  p->base = (uint8_t *) base + state_pages * PGSIZE;
+  p->name = name;
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      list_init (&p->free[order]);
+      p->free_cnt[order] = 0;
+    }
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->zero_hits = p->zero_misses = p->idle_zeroed = 0;
+  free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +394,180 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the first page of the block at PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (const struct pool *pool, size_t page_idx) 
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the block whose first page is ELEM. */
+static size_t
+block_idx (const struct pool *pool, struct list_elem *elem) 
+{
+  return ((uint8_t *) elem - pool->base) / PGSIZE;
+}
+
+/* Removes a free block of 2**ORDER pages from POOL, splitting a
+   larger one if necessary, and returns its page index, or
+   NO_BLOCK if no block is large enough.  Interrupts must be
+   off. */
+static size_t
+alloc_block (struct pool *pool, int order) 
+{
+  size_t page_idx;
+  int k;
+
+  for (k = order; k < ORDER_CNT; k++)
+    if (!list_empty (&pool->free[k]))
+      break;
+  if (k == ORDER_CNT)
+    return NO_BLOCK;
+
+  page_idx = block_idx (pool, list_pop_front (&pool->free[k]));
+  pool->free_cnt[k]--;
+  pool->state[page_idx] = 0;
+
+  /* Return the upper half of each split to the free lists. */
+  while (k > order)
+    {
+      size_t half_idx;
+
+      k--;
+      half_idx = page_idx + ((size_t) 1 << k);
+      pool->state[half_idx] = STATE_FREE | k;
+      list_push_front (&pool->free[k], block_elem (pool, half_idx));
+      pool->free_cnt[k]++;
+    }
+  return page_idx;
+}
+
+/* Returns the block of 2**ORDER pages at PAGE_IDX to POOL,
+   merging it with its buddy as long as the buddy is free.
+   Interrupts must be off. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  ASSERT (!(pool->state[page_idx] & STATE_FREE));
+
+  for (; order < ORDER_CNT - 1; order++)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+      if (buddy_idx + ((size_t) 1 << order) > pool->page_cnt
+          || pool->state[buddy_idx] != (STATE_FREE | order))
+        break;
+
+      list_remove (block_elem (pool, buddy_idx));
+      pool->free_cnt[order]--;
+      pool->state[buddy_idx] = 0;
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+    }
+
+  pool->state[page_idx] = STATE_FREE | order;
+  list_push_front (&pool->free[order], block_elem (pool, page_idx));
+  pool->free_cnt[order]++;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL, as
+   the largest properly aligned blocks that fit.  Interrupts
+   must be off. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order < ORDER_CNT - 1
+             && page_idx % ((size_t) 2 << order) == 0
+             && (size_t) 2 << order <= page_cnt)
+        order++;
+
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Returns the index of the free block in POOL that contains page
+   PAGE_IDX, storing its order into *ORDER, or NO_BLOCK if
+   PAGE_IDX is in use.  Interrupts must be off. */
+static size_t
+free_block_at (const struct pool *pool, size_t page_idx, int *order) 
+{
+  int k;
+
+  for (k = 0; k < ORDER_CNT; k++) 
+    {
+      size_t head = page_idx & ~(((size_t) 1 << k) - 1);
+      if (pool->state[head] == (STATE_FREE | k))
+        {
+          *order = k;
+          return head;
+        }
+    }
+  return NO_BLOCK;
+}
+
+/* Returns all of POOL's zeroed pages to its buddy system.
+   Interrupts must be off. */
+static void
+release_zeroed (struct pool *pool) 
+{
+  while (!list_empty (&pool->zeroed))
+    free_block (pool, block_idx (pool, list_pop_front (&pool->zeroed)), 0);
+  pool->zeroed_cnt = 0;
+}
+
+/* Moves one free page of POOL to its zeroed list, if the list is
+   shorter than the target.  Returns true if successful, false
+   if the list is full or POOL has no free pages.  The page is
+   zeroed with interrupts on, while it belongs to neither the
+   buddy system nor the zeroed list. */
+static bool
+zero_one_page (struct pool *pool) 
+{
+  enum intr_level old_level;
+  size_t page_idx;
+  struct list_elem *e;
+
+  if (pool->zeroed_cnt >= zeroed_target)
+    return false;
+
+  old_level = intr_disable ();
+  page_idx = alloc_block (pool, 0);
+  intr_set_level (old_level);
+  if (page_idx == NO_BLOCK)
+    return false;
+
+  e = block_elem (pool, page_idx);
+  memset (e, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  list_push_front (&pool->zeroed, e);
+  pool->zeroed_cnt++;
+  pool->idle_zeroed++;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Prints POOL's free block counts and zeroed page statistics. */
+static void
+print_pool_stats (const struct pool *pool) 
+{
+  int order;
+
+  printf ("palloc: %s free blocks by order:", pool->name);
+  for (order = 0; order < ORDER_CNT; order++)
+    printf (" %zu", pool->free_cnt[order]);
+  printf ("\n");
+  printf ("palloc: %s zeroed pages: %zu, %zu hits, %zu misses, "
+          "%zu zeroed while idle\n",
+          pool->name, pool->zeroed_cnt, pool->zero_hits,
+          pool->zero_misses, pool->idle_zeroed);
+}
@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,10 +12,14 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
-void palloc_init (size_t user_page_limit);
+void palloc_init (size_t user_page_limit, size_t zeroed_page_target);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_grow (void *pages, size_t page_cnt, size_t new_cnt);
+bool palloc_idle_zero (void);
+void *palloc_user_start (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
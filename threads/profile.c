@@ -0,0 +1,194 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/pagedir.h"
+#endif
+
+/* Number of addresses recorded per sample: the interrupted
+   instruction plus PROFILE_DEPTH - 1 callers. */
+#define PROFILE_DEPTH 4
+
+/* Number of distinct call stacks we can count.  Must be a
+   power of 2. */
+#define PROFILE_SLOTS 1024
+
+/* Number of slots to probe before giving up on a sample. */
+#define PROFILE_PROBES 16
+
+/* A call stack and the number of times it was sampled. */
+struct sample 
+  {
+    uintptr_t pcs[PROFILE_DEPTH]; /* Addresses, innermost first. */
+    unsigned count;               /* # of times seen, 0 if slot free. */
+  };
+
+/* If true, sample on every timer interrupt.
+   Controlled by kernel command-line option "-profile". */
+bool profile_enabled;
+
+/* Open-addressed hash table of samples.  Only touched by the
+   timer interrupt handler and, with interrupts off, by
+   profile_dump(). */
+static struct sample samples[PROFILE_SLOTS];
+static unsigned sample_cnt;     /* # of samples taken. */
+static unsigned dropped_cnt;    /* # of samples that found no slot. */
+
+static void walk_stack (const struct intr_frame *, uintptr_t pcs[]);
+static bool read_frame (uintptr_t ebp, bool user, uintptr_t frame[2]);
+static int sample_more (const void *, const void *);
+
+/* Records a sample of the code interrupted by the timer
+   interrupt whose frame is F. */
+void
+profile_sample (const struct intr_frame *f) 
+{
+  uintptr_t pcs[PROFILE_DEPTH];
+  unsigned hash = 0;
+  int i, j;
+
+  ASSERT (intr_context ());
+
+  for (i = 0; i < PROFILE_DEPTH; i++)
+    pcs[i] = 0;
+  walk_stack (f, pcs);
+  for (i = 0; i < PROFILE_DEPTH; i++)
+    hash = hash * 31 + pcs[i];
+  sample_cnt++;
+
+  for (i = 0; i < PROFILE_PROBES; i++)
+    {
+      struct sample *s = &samples[(hash + i) % PROFILE_SLOTS];
+      if (s->count == 0)
+        {
+          for (j = 0; j < PROFILE_DEPTH; j++)
+            s->pcs[j] = pcs[j];
+        }
+      else
+        {
+          for (j = 0; j < PROFILE_DEPTH; j++)
+            if (s->pcs[j] != pcs[j])
+              break;
+          if (j < PROFILE_DEPTH)
+            continue;
+        }
+      s->count++;
+      return;
+    }
+  dropped_cnt++;
+}
+
+/* Prints the profile, most frequently sampled call stacks
+   first.  Each line gives the number of samples, their share
+   of the total, and the call stack's addresses. */
+void
+profile_dump (char **argv UNUSED) 
+{
+  struct sample *sorted;
+  enum intr_level old_level;
+  size_t cnt, i;
+  unsigned total;
+  int j;
+
+  sorted = malloc (sizeof samples);
+  if (sorted == NULL)
+    PANIC ("couldn't allocate profile buffer");
+
+  old_level = intr_disable ();
+  cnt = 0;
+  for (i = 0; i < PROFILE_SLOTS; i++)
+    if (samples[i].count != 0)
+      sorted[cnt++] = samples[i];
+  total = sample_cnt;
+  intr_set_level (old_level);
+
+  qsort (sorted, cnt, sizeof *sorted, sample_more);
+  printf ("Profile: %u samples, %u dropped.\n", total, dropped_cnt);
+  for (i = 0; i < cnt; i++)
+    {
+      unsigned permille = sorted[i].count * 1000ull / total;
+      printf ("Profile: %u %u.%u%%", sorted[i].count,
+              permille / 10, permille % 10);
+      for (j = 0; j < PROFILE_DEPTH && sorted[i].pcs[j] != 0; j++)
+        printf (" %#"PRIxPTR, sorted[i].pcs[j]);
+      printf ("\n");
+    }
+  free (sorted);
+}
+
+/* Fills PCS with the interrupted EIP in frame F and the return
+   addresses of its callers, found by following the chain of
+   saved frame pointers.  The walk stops at the first frame
+   pointer that does not point into the interrupted stack: the
+   running thread's kernel stack, or mapped user memory. */
+static void
+walk_stack (const struct intr_frame *f, uintptr_t pcs[]) 
+{
+  bool user = f->cs != SEL_KCSEG;
+  uintptr_t ebp = f->ebp;
+  int n = 0;
+
+  pcs[n++] = (uintptr_t) f->eip;
+  while (n < PROFILE_DEPTH)
+    {
+      uintptr_t frame[2];
+      if (!read_frame (ebp, user, frame) || frame[1] == 0)
+        break;
+      pcs[n++] = frame[1];
+      if (frame[0] <= ebp)
+        break;
+      ebp = frame[0];
+    }
+}
+
+/* Reads the saved frame pointer and return address at EBP into
+   FRAME[0] and FRAME[1], if EBP points to a stack frame we can
+   safely read.  USER says whether the interrupted code was
+   running in user mode. */
+static bool
+read_frame (uintptr_t ebp, bool user, uintptr_t frame[2]) 
+{
+  const uintptr_t *p = (const uintptr_t *) ebp;
+
+  /* Both words must be aligned and on the same page. */
+  if (ebp % sizeof (uintptr_t) != 0
+      || pg_ofs (p) > PGSIZE - 2 * sizeof (uintptr_t))
+    return false;
+
+  if (user)
+    {
+#ifdef USERPROG
+      uint32_t *pd = thread_current ()->pagedir;
+      if (pd == NULL || !is_user_vaddr (p) || pagedir_get_page (pd, p) == NULL)
+        return false;
+#else
+      return false;
+#endif
+    }
+  else if (pg_round_down (p) != pg_round_down (thread_current ())
+           || (const void *) p < (const void *) (thread_current () + 1))
+    return false;
+
+  frame[0] = p[0];
+  frame[1] = p[1];
+  return true;
+}
+
+/* qsort() comparison function that orders samples by
+   descending count. */
+static int
+sample_more (const void *a_, const void *b_) 
+{
+  const struct sample *a = a_;
+  const struct sample *b = b_;
+
+  return a->count < b->count ? 1 : a->count > b->count ? -1 : 0;
+}
@@ -0,0 +1,21 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+
+/* Statistical profiler.
+
+   When enabled with the "-profile" kernel option, every timer
+   interrupt records the interrupted instruction and the return
+   addresses of a few of its callers, and counts how often each
+   such call stack is seen.  The "profile" action prints the
+   counts, most frequent first, in a form that "backtrace
+   --profile" turns into function names. */
+
+extern bool profile_enabled;
+
+struct intr_frame;
+void profile_sample (const struct intr_frame *);
+void profile_dump (char **argv);
+
+#endif /* threads/profile.h */
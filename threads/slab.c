@@ -0,0 +1,257 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Each slab is one page.  A struct slab at the start of the page
+   is followed by a stack of the indexes of the slab's free
+   objects, and then by the objects themselves.  Keeping the free
+   stack outside the objects means that freeing an object does
+   not disturb its constructed state.
+
+   A cache keeps its slabs on three lists, according to whether
+   all, some, or none of their objects are in use.  Allocation
+   takes from a partially used slab if there is one, so that
+   slabs fill up and empty slabs can be returned to the page
+   allocator.  A cache holds on to at most EMPTY_MAX empty slabs,
+   to avoid creating and destroying a slab over and over at a
+   boundary; kmem_cache_shrink() releases those too. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Maximum number of empty slabs a cache keeps. */
+#define EMPTY_MAX 1
+
+/* Alignment of objects within a slab. */
+#define OBJ_ALIGN 4
+
+/* A slab. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in a cache's slab list. */
+    size_t in_use;              /* Number of objects allocated. */
+    size_t free_cnt;            /* Number of entries in free_stack. */
+    uint16_t free_stack[];      /* Indexes of free objects. */
+  };
+
+/* List of all caches, for statistics. */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+static struct slab *slab_create (struct kmem_cache *);
+static void slab_destroy (struct slab *);
+static void *slab_obj (const struct slab *, size_t idx);
+
+/* Initializes cache C, named NAME, for objects of SIZE bytes.
+   If CTOR is nonnull, it constructs each new object. */
+void
+kmem_cache_init (struct kmem_cache *c, const char *name, size_t size,
+                 kmem_ctor_func *ctor) 
+{
+  size_t n;
+
+  ASSERT (size > 0);
+
+  size = ROUND_UP (size, OBJ_ALIGN);
+  n = (PGSIZE - sizeof (struct slab)) / (size + sizeof (uint16_t));
+  while (n > 0
+         && (ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                       OBJ_ALIGN)
+             + n * size > PGSIZE))
+    n--;
+  ASSERT (n > 0);
+
+  c->name = name;
+  c->obj_size = size;
+  c->objs_per_slab = n;
+  c->obj_ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                         OBJ_ALIGN);
+  c->ctor = ctor;
+  lock_init (&c->lock);
+  list_init (&c->full);
+  list_init (&c->partial);
+  list_init (&c->empty);
+  c->slab_cnt = 0;
+  c->in_use = 0;
+  c->alloc_cnt = 0;
+  list_push_back (&all_caches, &c->elem);
+}
+
+/* Allocates and returns an object from cache C, or a null
+   pointer if no memory is available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) 
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->partial)) 
+    {
+      if (!list_empty (&c->empty))
+        list_push_front (&c->partial, list_pop_front (&c->empty));
+      else
+        {
+          /* Create a slab without holding the lock, because
+             running the constructor on every object may take a
+             while. */
+          lock_release (&c->lock);
+          s = slab_create (c);
+          if (s == NULL)
+            return NULL;
+          lock_acquire (&c->lock);
+          c->slab_cnt++;
+          list_push_front (&c->partial, &s->elem);
+        }
+    }
+
+  s = list_entry (list_front (&c->partial), struct slab, elem);
+  obj = slab_obj (s, s->free_stack[--s->free_cnt]);
+  s->in_use++;
+  if (s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full, &s->elem);
+    }
+  c->in_use++;
+  c->alloc_cnt++;
+  lock_release (&c->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   the cache.  OBJ may be a null pointer, in which case nothing
+   happens. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) 
+{
+  struct slab *s;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  idx = ((uint8_t *) obj - (uint8_t *) slab_obj (s, 0)) / c->obj_size;
+  ASSERT (slab_obj (s, idx) == obj);
+
+  lock_acquire (&c->lock);
+  ASSERT (s->free_cnt < c->objs_per_slab);
+  s->free_stack[s->free_cnt++] = idx;
+  s->in_use--;
+  c->in_use--;
+
+  if (s->in_use == 0)
+    {
+      /* Now empty.  Keep it, or give it back. */
+      list_remove (&s->elem);
+      if (list_size (&c->empty) < EMPTY_MAX)
+        list_push_front (&c->empty, &s->elem);
+      else
+        {
+          c->slab_cnt--;
+          lock_release (&c->lock);
+          slab_destroy (s);
+          return;
+        }
+    }
+  else if (s->free_cnt == 1)
+    {
+      /* Was full, now partial. */
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  lock_release (&c->lock);
+}
+
+/* Returns all of cache C's empty slabs to the page allocator.
+   Returns the number of pages released. */
+size_t
+kmem_cache_shrink (struct kmem_cache *c) 
+{
+  struct list empty;
+  size_t cnt = 0;
+
+  list_init (&empty);
+  lock_acquire (&c->lock);
+  while (!list_empty (&c->empty))
+    {
+      list_push_back (&empty, list_pop_front (&c->empty));
+      c->slab_cnt--;
+    }
+  lock_release (&c->lock);
+
+  while (!list_empty (&empty)) 
+    {
+      slab_destroy (list_entry (list_pop_front (&empty), struct slab, elem));
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Prints statistics for every cache. */
+void
+kmem_cache_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      printf ("Slab: %s: %zu-byte objects, %zu per slab, %zu slabs, "
+              "%zu in use, %llu allocations\n",
+              c->name, c->obj_size, c->objs_per_slab, c->slab_cnt,
+              c->in_use, c->alloc_cnt);
+    }
+}
+
+/* Creates and returns a new slab for cache C, with all of its
+   objects free and constructed, or returns a null pointer if no
+   page is available. */
+static struct slab *
+slab_create (struct kmem_cache *c) 
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free_cnt = c->objs_per_slab;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      /* Hand out low addresses first. */
+      s->free_stack[i] = c->objs_per_slab - 1 - i;
+      if (c->ctor != NULL)
+        c->ctor (slab_obj (s, i));
+    }
+  return s;
+}
+
+/* Returns slab S's page to the page allocator. */
+static void
+slab_destroy (struct slab *s) 
+{
+  s->magic = 0;
+  palloc_free_page (s);
+}
+
+/* Returns the address of object IDX in slab S. */
+static void *
+slab_obj (const struct slab *s, size_t idx) 
+{
+  return (uint8_t *) s + s->cache->obj_ofs + idx * s->cache->obj_size;
+}
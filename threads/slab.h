@@ -0,0 +1,52 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object caches ("slab allocator").
+
+   A cache hands out objects of a single size, carved out of
+   pages ("slabs") obtained from the page allocator.  Compared to
+   malloc(), which rounds every request up to a power of 2, a
+   cache packs objects of an odd size tightly, and each cache has
+   a lock of its own.
+
+   If a cache has a constructor, it is run on each object once,
+   when the object's slab is created, not on every allocation.
+   Objects must be freed in their constructed state, so that they
+   can be handed out again without construction.
+
+   Objects must be small enough that at least one fits in a page
+   along with the slab's header. */
+
+/* Constructs object OBJ. */
+typedef void kmem_ctor_func (void *obj);
+
+/* An object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    size_t obj_ofs;             /* Offset of first object in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    struct lock lock;           /* Protects the members below. */
+    struct list full;           /* Slabs with no free objects. */
+    struct list partial;        /* Slabs with some free objects. */
+    struct list empty;          /* Slabs with no objects in use. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t in_use;              /* Number of objects allocated. */
+    unsigned long long alloc_cnt; /* Number of allocations ever. */
+    struct list_elem elem;      /* Element in list of all caches. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+size_t kmem_cache_shrink (struct kmem_cache *);
+void kmem_cache_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -31,6 +31,33 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#ifdef LOCK_PROFILE
+#include "devices/timer.h"
+#endif
+
+/* Maximum length of a chain of nested priority donations.
+   Bounds the time lock_acquire() spends with interrupts off. */
+#define DONATION_DEPTH_MAX 8
+
+static void sema_wait (struct semaphore *, struct lock *);
+static void donate_priority (struct lock *);
+static bool cond_waiter_less (const struct list_elem *,
+                              const struct list_elem *, void *aux);
+
+#ifdef LOCK_PROFILE
+/* Lock contention profiler.
+
+   Each named lock or semaphore points to the profile for its
+   name, which accumulates statistics across every lock of that
+   name, so that, for example, the locks of all the malloc()
+   descriptors are reported together.  Waits and hold times are
+   measured in timer ticks. */
+#define LOCK_PROFILE_MAX 32
+static struct lock_profile profiles[LOCK_PROFILE_MAX];
+static size_t profile_cnt;
+
+static void profile_record_wait (struct lock_profile *, int64_t start);
+#endif
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -48,6 +75,9 @@ sema_init (struct semaphore *sema, unsigned value)
 
   sema->value = value;
   list_init (&sema->waiters);
+#ifdef LOCK_PROFILE
+  sema->profile = NULL;
+#endif
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -60,18 +90,47 @@ sema_init (struct semaphore *sema, unsigned value)
 void
 sema_down (struct semaphore *sema) 
 {
+  sema_wait (sema, NULL);
+}
+
+/* Implements sema_down().  If LOCK is nonnull, then SEMA is
+   LOCK's semaphore, and every time the running thread is about
+   to block, it registers as a donor to LOCK's current holder and
+   donates its priority.  That has to happen on each pass, not
+   just the first: a waiter woken by lock_release() can lose the
+   lock to a thread that gets there first, and must then donate
+   to that thread instead. */
+static void
+sema_wait (struct semaphore *sema, struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
   enum intr_level old_level;
+#ifdef LOCK_PROFILE
+  int64_t wait_start;
+#endif
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
+#ifdef LOCK_PROFILE
+  wait_start = sema->value == 0 ? timer_ticks () : -1;
+#endif
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      if (lock != NULL && lock->holder != NULL)
+        {
+          cur->waiting_lock = lock;
+          list_push_back (&lock->holder->donors, &cur->donor_elem);
+          donate_priority (lock);
+        }
+      list_push_back (&sema->waiters, &cur->elem);
       thread_block ();
     }
   sema->value--;
+#ifdef LOCK_PROFILE
+  profile_record_wait (sema->profile, wait_start);
+#endif
   intr_set_level (old_level);
 }
 
@@ -93,6 +152,9 @@ sema_try_down (struct semaphore *sema)
     {
       sema->value--;
       success = true; 
+#ifdef LOCK_PROFILE
+      profile_record_wait (sema->profile, -1);
+#endif
     }
   else
     success = false;
@@ -102,7 +164,16 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  Among waiters of equal priority, the one that
+   has waited longest is woken first, so no waiter can be passed
+   over indefinitely by others of its own priority.  Yields if
+   the woken thread has a higher priority than the running
+   thread.
+
+   The waiter is chosen when SEMA is upped, rather than ordered
+   when it is downed, because priority donation can change a
+   waiter's priority while it sleeps.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +185,16 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -185,6 +262,11 @@ lock_init (struct lock *lock)
    necessary.  The lock must not already be held by the current
    thread.
 
+   If the lock is held by a lower-priority thread, the current
+   thread donates its priority to the holder, and onward along
+   the chain of locks that the holder is itself waiting on, so
+   that the holder cannot be starved by medium-priority threads.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +274,57 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  struct list_elem *e;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  old_level = intr_disable ();
+  sema_wait (&lock->semaphore, thread_mlfqs ? NULL : lock);
+
+  /* The threads still waiting for LOCK now wait on us. */
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+#ifdef LOCK_PROFILE
+  lock->acquire_tick = timer_ticks ();
+#endif
+  if (!thread_mlfqs)
+    {
+      for (e = list_begin (&lock->semaphore.waiters);
+           e != list_end (&lock->semaphore.waiters); e = list_next (e))
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+          list_push_back (&cur->donors, &t->donor_elem);
+        }
+      thread_refresh_priority (cur);
+    }
+  intr_set_level (old_level);
+}
+
+/* Propagates the running thread's priority to the holder of
+   LOCK, then to the holder of the lock that holder is waiting
+   on, and so on, up to DONATION_DEPTH_MAX locks deep.  Must be
+   called with interrupts off. */
+static void
+donate_priority (struct lock *lock) 
+{
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder;
+
+      if (lock == NULL || lock->holder == NULL)
+        break;
+      holder = lock->holder;
+      thread_refresh_priority (holder);
+      lock = holder->waiting_lock;
+    }
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,7 +343,12 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+#ifdef LOCK_PROFILE
+      lock->acquire_tick = timer_ticks ();
+#endif
+    }
   return success;
 }
 
@@ -228,11 +360,44 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  struct list_elem *e;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  /* Drop the donations made through LOCK and fall back to the
+     highest priority still donated through other locks. */
+  old_level = intr_disable ();
+  for (e = list_begin (&cur->donors); e != list_end (&cur->donors); )
+    {
+      struct thread *t = list_entry (e, struct thread, donor_elem);
+      if (t->waiting_lock == lock)
+        e = list_remove (e);
+      else
+        e = list_next (e);
+    }
+  thread_refresh_priority (cur);
+
+#ifdef LOCK_PROFILE
+  if (lock->semaphore.profile != NULL)
+    {
+      struct lock_profile *p = lock->semaphore.profile;
+      int64_t held = timer_ticks () - lock->acquire_tick;
+      if (held > p->max_hold_ticks)
+        {
+          p->max_hold_ticks = held;
+          strlcpy (p->max_holder, cur->name, sizeof p->max_holder);
+        }
+    }
+#endif
+
   lock->holder = NULL;
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -251,6 +416,7 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
 /* Initializes condition variable COND.  A condition variable
@@ -295,6 +461,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,7 +469,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one to wake up
+   from its wait, choosing the longest waiter among equals.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -317,8 +485,23 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters, cond_waiter_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
+}
+
+/* Compares the condition variable waiters A_ and B_ by the
+   priority of their waiting threads. */
+static bool
+cond_waiter_less (const struct list_elem *a_, const struct list_elem *b_,
+                  void *aux UNUSED) 
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem, elem);
+
+  return a->thread->priority < b->thread->priority;
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +519,77 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+#ifdef LOCK_PROFILE
+/* Names SEMA for the purpose of contention profiling.  Every
+   semaphore or lock given the same NAME, which must be a string
+   that is never freed, shares one set of statistics. */
+void
+sema_set_name (struct semaphore *sema, const char *name) 
+{
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT (sema != NULL);
+  ASSERT (name != NULL);
+
+  old_level = intr_disable ();
+  for (i = 0; i < profile_cnt; i++)
+    if (!strcmp (profiles[i].name, name))
+      break;
+  if (i == profile_cnt && profile_cnt < LOCK_PROFILE_MAX)
+    profiles[profile_cnt++].name = name;
+  sema->profile = i < profile_cnt ? &profiles[i] : NULL;
+  intr_set_level (old_level);
+}
+
+/* Names LOCK for the purpose of contention profiling. */
+void
+lock_set_name (struct lock *lock, const char *name) 
+{
+  ASSERT (lock != NULL);
+
+  sema_set_name (&lock->semaphore, name);
+}
+
+/* Prints contention statistics for each named lock. */
+void
+lock_print_stats (void) 
+{
+  size_t i;
+
+  for (i = 0; i < profile_cnt; i++)
+    {
+      const struct lock_profile *p = &profiles[i];
+      printf ("Lock \"%s\": %lld acquires, %lld contended, "
+              "%lld wait ticks (max %lld)",
+              p->name, p->acquire_cnt, p->contended_cnt,
+              (long long) p->wait_ticks, (long long) p->max_wait_ticks);
+      if (p->max_holder[0] != '\0')
+        printf (", held up to %lld ticks by \"%s\"",
+                (long long) p->max_hold_ticks, p->max_holder);
+      printf ("\n");
+    }
+}
+
+/* Records an acquisition in profile P, which may be null, that
+   began waiting at timer tick START, or -1 if it did not wait.
+   Must be called with interrupts off. */
+static void
+profile_record_wait (struct lock_profile *p, int64_t start) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (p == NULL)
+    return;
+  p->acquire_cnt++;
+  if (start >= 0)
+    {
+      int64_t wait = timer_ticks () - start;
+      p->contended_cnt++;
+      p->wait_ticks += wait;
+      if (wait > p->max_wait_ticks)
+        p->max_wait_ticks = wait;
+    }
+}
+#endif /* LOCK_PROFILE */
@@ -3,12 +3,31 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#ifdef LOCK_PROFILE
+/* Contention statistics, shared by all of the locks and
+   semaphores given the same name. */
+struct lock_profile 
+  {
+    const char *name;           /* Name given to the locks. */
+    long long acquire_cnt;      /* # of acquisitions. */
+    long long contended_cnt;    /* # of acquisitions that waited. */
+    int64_t wait_ticks;         /* Total ticks spent waiting. */
+    int64_t max_wait_ticks;     /* Longest single wait. */
+    int64_t max_hold_ticks;     /* Longest a lock was held. */
+    char max_holder[16];        /* Name of thread that held it longest. */
+  };
+#endif
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
     struct list waiters;        /* List of waiting threads. */
+#ifdef LOCK_PROFILE
+    struct lock_profile *profile; /* Statistics, or null if unnamed. */
+#endif
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -22,6 +41,9 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+#ifdef LOCK_PROFILE
+    int64_t acquire_tick;       /* Timer tick when acquired. */
+#endif
   };
 
 void lock_init (struct lock *);
@@ -30,6 +52,18 @@ bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Lock contention profiling.  Build with "make LOCK_PROFILE=1"
+   to enable it; otherwise these compile to nothing. */
+#ifdef LOCK_PROFILE
+void sema_set_name (struct semaphore *, const char *name);
+void lock_set_name (struct lock *, const char *name);
+void lock_print_stats (void);
+#else
+#define sema_set_name(SEMA, NAME) ((void) 0)
+#define lock_set_name(LOCK, NAME) ((void) 0)
+#define lock_print_stats() ((void) 0)
+#endif
+
 /* Condition variable. */
 struct condition 
   {
@@ -2,18 +2,23 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "vm/frame.h"
 #include "vm/page.h"
 #ifdef USERPROG
+#include "userprog/fpu.h"
 #include "userprog/process.h"
 #include "filesys/file.h"
 #endif
@@ -23,14 +28,52 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO queue per priority level.  Bit P of
+   ready_mask is set if and only if ready_queues[P] is nonempty,
+   so the highest-priority ready thread can be found with a
+   single bit scan instead of a list walk. */
+static struct list ready_queues[PRI_MAX + 1];
+#define READY_MASK_BITS 32
+static uint32_t ready_mask[(PRI_MAX + READY_MASK_BITS) / READY_MASK_BITS];
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
+/* Run queue of the completely fair scheduler, which replaces
+   ready_queues when thread_cfs is true.  Threads are ordered by
+   virtual runtime, so the thread that has received the least
+   weighted CPU time is always the leftmost. */
+static struct rb_tree cfs_queue;
+
+/* Earliest-deadline-first real-time class.
+
+   Real-time threads reserve RUNTIME ticks of CPU time in every
+   PERIOD ticks, to be received within DEADLINE ticks of the
+   start of each period.  Ready real-time threads run ahead of
+   all other threads, earliest absolute deadline first.  A
+   real-time thread that uses up its budget for a period is
+   throttled until its next period begins, so that it cannot
+   take more than it reserved.
+
+   thread_set_deadline() only admits a thread if the total
+   density, RUNTIME / min (DEADLINE, PERIOD), of all real-time
+   threads stays within RT_DENSITY_MAX, which guarantees that
+   EDF meets every deadline and leaves some CPU time for
+   everybody else. */
+#define RT_DENSITY_MAX 900      /* Max total density, in 1/1000. */
+static struct list rt_queue;    /* Ready RT threads, by deadline. */
+static struct list rt_throttled_list; /* Throttled RT threads. */
+static int rt_density;          /* Total density of RT threads. */
+static long long rt_admit_cnt;  /* # of threads admitted. */
+static long long rt_reject_cnt; /* # of threads rejected. */
+static long long rt_miss_cnt;   /* # of deadlines missed. */
+
+/* Number of threads in the run queues. */
+static int ready_cnt;
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -40,6 +83,18 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Cache of pages freed by dying threads, recycled by
+   thread_create() without going back to the page allocator.
+   init_thread() reinitializes the whole of struct thread, and
+   nothing depends on the stack below it starting out zeroed, so
+   a recycled page needs no other preparation.  Accessed with
+   interrupts off, since thread_schedule_tail() fills it. */
+#define THREAD_CACHE_MAX 8
+static struct thread *thread_cache[THREAD_CACHE_MAX];
+static size_t thread_cache_cnt;
+static long long thread_cache_hits;     /* # of pages reused. */
+static long long thread_cache_misses;   /* # of pages from palloc. */
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -62,11 +117,77 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler. */
+#define MLFQS_PRI_TICKS 4       /* # of timer ticks between priority updates. */
+static fixed_t load_avg;        /* System load average. */
+
+/* Threads whose recent_cpu has changed since their priority was
+   last computed.  Only threads that actually ran are charged
+   recent_cpu between the once-per-second global updates, so the
+   priority update every MLFQS_PRI_TICKS ticks visits just these
+   threads instead of every thread in the system. */
+static struct list cpu_changed_list;
+
+/* If true, use completely fair scheduler.
+   Controlled by kernel command-line option "-sched=cfs". */
+bool thread_cfs;
+
+/* Completely fair scheduler.
+
+   Each thread's vruntime advances as it runs, at a rate
+   inversely proportional to its weight, which is derived from
+   its nice value.  The scheduler always runs the ready thread
+   with the smallest vruntime, so over time each thread receives
+   CPU time in proportion to its weight, without any periodic
+   global recomputation.
+
+   vruntime is measured in units of 1/CFS_WEIGHT_0 timer tick of
+   a nice-0 thread. */
+#define CFS_WEIGHT_0 1024       /* Weight of a nice-0 thread. */
+#define CFS_MIN_GRAN_TICKS 1    /* Minimum # of ticks before preemption. */
+#define CFS_WAKEUP_GRAN (CFS_WEIGHT_0 * 1) /* vruntime lead to preempt. */
+#define CFS_SLEEPER_CREDIT (CFS_WEIGHT_0 * TIME_SLICE) /* Max catch-up. */
+static int64_t cfs_min_vruntime; /* Monotonic floor of vruntimes. */
+
+/* CFS weight for each nice value from NICE_MIN to NICE_MAX.
+   Each step in niceness changes the CPU share by about 10%. */
+static const int cfs_weights[NICE_MAX - NICE_MIN + 1] =
+  {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+    /*  20 */    12,
+  };
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static void mlfqs_tick (struct thread *);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static void cfs_tick (struct thread *);
+static void cfs_update_min_vruntime (void);
+static bool cfs_less (const struct rb_elem *, const struct rb_elem *,
+                      void *aux);
+static bool ready_queue_preempts (const struct thread *);
+static void rt_tick (struct thread *);
+static void rt_replenish (struct thread *, int64_t now);
+static bool rt_deadline_less (const struct list_elem *,
+                              const struct list_elem *, void *aux);
+static void print_thread_share (struct thread *, void *aux);
+static int ready_queue_max_priority (void);
+static struct thread *thread_page_alloc (void);
+static void thread_page_free (struct thread *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -90,11 +211,19 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  lock_set_name (&tid_lock, "tid");
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
+  rb_init (&cfs_queue, cfs_less, NULL);
   list_init (&all_list);
+  list_init (&cpu_changed_list);
+  list_init (&rt_queue);
+  list_init (&rt_throttled_list);
   // hash_init (&frames, &frame_hash, &frame_less, NULL);
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -137,9 +266,21 @@ thread_tick (void)
 #endif
   else
     kernel_ticks++;
-
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  t->run_ticks++;
+
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
+  /* Enforce preemption.  Real-time threads are not time-sliced:
+     rt_tick() preempts them when their budget runs out or an
+     earlier deadline becomes ready. */
+  ++thread_ticks;
+  rt_tick (t);
+  if (t->rt_period != 0)
+    return;
+  if (thread_cfs)
+    cfs_tick (t);
+  else if (thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
@@ -149,6 +290,34 @@ thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld page cache hits, %lld misses\n",
+          thread_cache_hits, thread_cache_misses);
+  if (thread_cfs)
+    {
+      enum intr_level old_level = intr_disable ();
+      thread_foreach (print_thread_share, NULL);
+      intr_set_level (old_level);
+    }
+  if (rt_admit_cnt > 0 || rt_reject_cnt > 0)
+    printf ("Thread: %lld real-time threads admitted, %lld rejected, "
+            "%lld deadlines missed\n",
+            rt_admit_cnt, rt_reject_cnt, rt_miss_cnt);
+}
+
+/* Prints thread T's virtual runtime and the share of non-idle
+   CPU time it has received. */
+static void
+print_thread_share (struct thread *t, void *aux UNUSED) 
+{
+  long long busy_ticks = kernel_ticks + user_ticks;
+  long long share = busy_ticks > 0 ? t->run_ticks * 1000 / busy_ticks : 0;
+
+  if (t == idle_thread)
+    return;
+  printf ("Thread: \"%s\" (tid %d): nice %d, vruntime %lld, "
+          "%lld ticks, %lld.%lld%% share\n",
+          t->name, t->tid, t->nice, (long long) t->vruntime,
+          (long long) t->run_ticks, share / 10, share % 10);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -163,9 +332,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, it preempts the running thread immediately. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -180,7 +348,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_alloc ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -198,6 +366,10 @@ thread_create (const char *name, int priority,
   t->hash_table = page_init();
   //end addition
 
+  /* Start the new thread level with the threads already
+     competing, so that it neither starves nor hogs the CPU. */
+  t->vruntime = cfs_min_vruntime;
+
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
@@ -247,6 +419,7 @@ thread_block (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   thread_current ()->status = THREAD_BLOCKED;
+  trace_event (TRACE_BLOCK, thread_current (), 0);
   schedule ();
 }
 
@@ -254,10 +427,13 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only if interrupts were on
+   or we are in an interrupt handler.  This can be important: if
+   the caller had disabled interrupts itself, it may expect that
+   it can atomically unblock a thread and update other data.
+   Such callers should call thread_preempt() once they turn
+   interrupts back on. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -267,9 +443,20 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (t->rt_period != 0)
+    rt_replenish (t, timer_ticks ());
+  if (thread_cfs && t->vruntime < cfs_min_vruntime - CFS_SLEEPER_CREDIT)
+    {
+      /* Don't let a long sleeper monopolize the CPU to catch up
+         on all the time it spent asleep. */
+      t->vruntime = cfs_min_vruntime - CFS_SLEEPER_CREDIT;
+    }
+  ready_queue_push (t);
   t->status = THREAD_READY;
+  trace_event (TRACE_UNBLOCK, t, t->priority);
   intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the name of the running thread. */
@@ -345,13 +532,17 @@ thread_exit (void)
 
 #ifdef USERPROG
   process_exit ();
+  fpu_release (cur);
 #endif
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  rt_density -= thread_current ()->rt_density;
   list_remove (&thread_current()->allelem);
+  if (thread_current ()->cpu_changed)
+    list_remove (&thread_current ()->cpu_elem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -369,12 +560,30 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_queue_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  Within an interrupt handler, the yield
+   happens just before the handler returns.  Does nothing if
+   interrupts are off outside an interrupt handler, since the
+   caller is then in the middle of an atomic update. */
+void
+thread_preempt (void) 
+{
+  if (intr_context ())
+    {
+      if (ready_queue_preempts (running_thread ()))
+        intr_yield_on_return ();
+    }
+  else if (intr_get_level () == INTR_ON
+           && ready_queue_preempts (thread_current ()))
+    thread_yield ();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -392,11 +601,153 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   effective priority stays higher while other threads donate a
+   higher priority to us.  Yields if the running thread no
+   longer has the highest priority. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The MLFQS scheduler computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_refresh_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Makes the running thread a real-time thread that needs
+   RUNTIME ticks of CPU time in every PERIOD ticks, each within
+   DEADLINE ticks of the start of the period, or, if PERIOD is
+   0, returns it to its normal scheduling class.  Returns false,
+   leaving the thread's class unchanged, if the parameters are
+   invalid or admitting the thread would over-subscribe the
+   CPU. */
+bool
+thread_set_deadline (int64_t period, int64_t runtime, int64_t deadline) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int density = 0;
+  bool success = true;
+
+  ASSERT (!intr_context ());
+
+  if (period != 0)
+    {
+      int64_t window = deadline < period ? deadline : period;
+      if (period < 0 || runtime <= 0 || runtime > window)
+        success = false;
+      else
+        density = DIV_ROUND_UP (runtime * 1000, window);
+    }
+
+  old_level = intr_disable ();
+  if (!success || rt_density - cur->rt_density + density > RT_DENSITY_MAX)
+    {
+      rt_reject_cnt++;
+      success = false;
+    }
+  else
+    {
+      rt_density += density - cur->rt_density;
+      cur->rt_density = density;
+      cur->rt_period = period;
+      cur->rt_runtime = runtime;
+      cur->rt_rel_deadline = deadline;
+      if (period != 0)
+        {
+          cur->rt_period_start = timer_ticks ();
+          cur->rt_deadline = cur->rt_period_start + deadline;
+          cur->rt_budget = runtime;
+          cur->rt_throttled = cur->rt_missed = false;
+          rt_admit_cnt++;
+        }
+      else
+        cur->vruntime = cfs_min_vruntime;
+    }
+  intr_set_level (old_level);
+
+  thread_preempt ();
+  return success;
+}
+
+/* Returns the tick at which the earliest throttled real-time
+   thread may run again, or INT64_MAX if none is throttled.
+   Interrupts must be off. */
+int64_t
+thread_rt_next_replenish (void) 
+{
+  int64_t next = INT64_MAX;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&rt_throttled_list); e != list_end (&rt_throttled_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      if (t->rt_period_start + t->rt_period < next)
+        next = t->rt_period_start + t->rt_period;
+    }
+  return next;
+}
+
+/* Compares the threads whose `elem' members are A_ and B_ by
+   effective priority.  Returns true if A's priority is lower
+   than B's.  Suitable for list_max() on the run queues and on
+   semaphore wait lists. */
+bool
+thread_priority_less (const struct list_elem *a_, const struct list_elem *b_,
+                      void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
+/* Recomputes T's effective priority as the maximum of its base
+   priority and the priorities donated to it, moving T to the
+   matching run queue if it is ready.  Does not preempt the
+   running thread.  Must be called with interrupts off. */
+void
+thread_refresh_priority (struct thread *t) 
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->donors); e != list_end (&t->donors);
+       e = list_next (e))
+    {
+      struct thread *donor = list_entry (e, struct thread, donor_elem);
+      if (donor->priority > priority)
+        priority = donor->priority;
+    }
+
+  if (priority == t->priority)
+    return;
+  trace_event (TRACE_PRIORITY, t, priority);
+  if (t->status == THREAD_READY)
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else
+    t->priority = priority;
 }
 
 /* Returns the current thread's priority. */
@@ -406,37 +757,280 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority.  Yields if the running thread no longer has the
+   highest priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent_cpu_100;
+}
+
+/* Does the multi-level feedback queue scheduler's bookkeeping
+   for timer tick in which thread T was running.  Runs in an
+   external interrupt context.
+
+   Each tick, the running thread is charged for the tick.  Once
+   per second, the load average and every thread's recent_cpu
+   and priority are recomputed.  Otherwise, every MLFQS_PRI_TICKS
+   ticks, only the threads charged since their last update have
+   their priorities recomputed, since no other thread's priority
+   can have changed. */
+static void
+mlfqs_tick (struct thread *t) 
+{
+  int64_t now = timer_ticks ();
+
+  if (t != idle_thread)
+    {
+      t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+      if (!t->cpu_changed)
+        {
+          t->cpu_changed = true;
+          list_push_back (&cpu_changed_list, &t->cpu_elem);
+        }
+    }
+
+  if (now % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_cnt + (t != idle_thread ? 1 : 0);
+      load_avg = (fp_mul (fp_div (fp_from_int (59), fp_from_int (60)),
+                          load_avg)
+                  + fp_from_int (ready_threads) / 60);
+      thread_foreach (mlfqs_update_recent_cpu, NULL);
+    }
+  else if (now % MLFQS_PRI_TICKS == 0)
+    {
+      while (!list_empty (&cpu_changed_list))
+        {
+          struct list_elem *e = list_pop_front (&cpu_changed_list);
+          struct thread *c = list_entry (e, struct thread, cpu_elem);
+          c->cpu_changed = false;
+          mlfqs_update_priority (c);
+        }
+    }
+  else
+    return;
+
+  thread_preempt ();
+}
+
+/* Does the completely fair scheduler's bookkeeping for a timer
+   tick in which thread T was running: charges T's vruntime for
+   the tick, weighted by its nice value, and preempts T once it
+   has run for at least CFS_MIN_GRAN_TICKS and has pulled ahead
+   of the leftmost ready thread.  Runs in an external interrupt
+   context. */
+static void
+cfs_tick (struct thread *t) 
+{
+  if (t != idle_thread)
+    {
+      t->vruntime += (CFS_WEIGHT_0 * CFS_WEIGHT_0
+                      / cfs_weights[t->nice - NICE_MIN]);
+      cfs_update_min_vruntime ();
+    }
+  if (thread_ticks >= CFS_MIN_GRAN_TICKS && ready_queue_preempts (t))
+    intr_yield_on_return ();
+}
+
+/* Advances cfs_min_vruntime to the smallest vruntime among the
+   running thread and the ready threads.  cfs_min_vruntime never
+   decreases. */
+static void
+cfs_update_min_vruntime (void) 
+{
+  struct thread *cur = running_thread ();
+  struct rb_elem *min = rb_min (&cfs_queue);
+  int64_t vruntime;
+
+  if (cur != idle_thread && cur->status == THREAD_RUNNING)
+    {
+      vruntime = cur->vruntime;
+      if (min != NULL
+          && rb_entry (min, struct thread, cfs_elem)->vruntime < vruntime)
+        vruntime = rb_entry (min, struct thread, cfs_elem)->vruntime;
+    }
+  else if (min != NULL)
+    vruntime = rb_entry (min, struct thread, cfs_elem)->vruntime;
+  else
+    return;
+
+  if (vruntime > cfs_min_vruntime)
+    cfs_min_vruntime = vruntime;
+}
+
+/* Orders threads in the CFS run queue by ascending vruntime. */
+static bool
+cfs_less (const struct rb_elem *a_, const struct rb_elem *b_,
+          void *aux UNUSED) 
+{
+  const struct thread *a = rb_entry (a_, struct thread, cfs_elem);
+  const struct thread *b = rb_entry (b_, struct thread, cfs_elem);
+
+  return a->vruntime < b->vruntime;
+}
+
+/* Decays thread T's recent_cpu according to the load average
+   and recomputes its priority.  Called once per second for
+   every thread. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED) 
+{
+  fixed_t twice_load = load_avg * 2;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (fp_div (twice_load,
+                                               fp_add_int (twice_load, 1)),
+                                      t->recent_cpu),
+                              t->nice);
+  if (t->cpu_changed)
+    {
+      list_remove (&t->cpu_elem);
+      t->cpu_changed = false;
+    }
+  mlfqs_update_priority (t);
+}
+
+/* Returns the MLFQS priority for thread T given its recent_cpu
+   and nice values: PRI_MAX - recent_cpu / 4 - nice * 2, rounded
+   down to an integer. */
+static int
+mlfqs_priority (const struct thread *t) 
+{
+  int priority = fp_to_int (fp_sub_int (fp_from_int (PRI_MAX)
+                                        - t->recent_cpu / 4,
+                                        t->nice * 2));
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
+}
+
+/* Recomputes thread T's priority from its recent_cpu and nice
+   values, moving T to the matching run queue if it is ready. */
+static void
+mlfqs_update_priority (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t == idle_thread)
+    return;
+  t->base_priority = mlfqs_priority (t);
+  thread_refresh_priority (t);
 }
 
+/* Charges the running thread T, if it is a real-time thread,
+   for one tick of its budget, throttling it if the budget is
+   spent, and lets throttled threads whose next period has begun
+   run again. */
+static void
+rt_tick (struct thread *t) 
+{
+  int64_t now = timer_ticks ();
+  bool replenished = false;
+  struct list_elem *e;
+
+  for (e = list_begin (&rt_throttled_list); e != list_end (&rt_throttled_list); )
+    {
+      struct thread *r = list_entry (e, struct thread, elem);
+      e = list_next (e);
+      if (now >= r->rt_period_start + r->rt_period)
+        {
+          list_remove (&r->elem);
+          rt_replenish (r, now);
+          ready_queue_push (r);
+          replenished = true;
+        }
+    }
+
+  if (t->rt_period != 0)
+    {
+      rt_replenish (t, now);
+      if (now > t->rt_deadline && !t->rt_missed)
+        {
+          t->rt_missed = true;
+          rt_miss_cnt++;
+        }
+      if (--t->rt_budget <= 0)
+        {
+          t->rt_throttled = true;
+          intr_yield_on_return ();
+          return;
+        }
+    }
+
+  if (replenished && ready_queue_preempts (t))
+    intr_yield_on_return ();
+}
+
+/* If real-time thread T's current period has ended by tick
+   NOW, starts the period that NOW falls in, with a fresh budget
+   and deadline. */
+static void
+rt_replenish (struct thread *t, int64_t now) 
+{
+  if (now < t->rt_period_start + t->rt_period)
+    return;
+  t->rt_period_start = now - (now - t->rt_period_start) % t->rt_period;
+  t->rt_deadline = t->rt_period_start + t->rt_rel_deadline;
+  t->rt_budget = t->rt_runtime;
+  t->rt_throttled = t->rt_missed = false;
+}
+
+/* Orders threads on rt_queue by ascending absolute deadline. */
+static bool
+rt_deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+                  void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->rt_deadline < b->rt_deadline;
+}
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -444,8 +1038,8 @@ thread_get_recent_cpu (void)
    point it initializes idle_thread, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   run queues.  It is returned by next_thread_to_run() as a
+   special case when the run queues are empty. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
@@ -459,6 +1053,21 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing else is ready to run.  Use the time to zero free
+         pages for palloc, one page at a time, for as long as
+         that stays true.  If a thread became ready meanwhile,
+         go back and run it. */
+      intr_enable ();
+      while (ready_cnt == 0 && palloc_idle_zero ())
+        continue;
+      intr_disable ();
+      if (ready_cnt > 0)
+        continue;
+
+      /* Unless a thread will need to wake up soon, stop the timer
+         from interrupting us on every tick. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -507,6 +1116,46 @@ is_thread (struct thread *t)
   return t != NULL && t->magic == THREAD_MAGIC;
 }
 
+/* Returns a page for a new thread, from the thread cache if
+   possible.  The page is not zeroed.  Returns a null pointer if
+   no memory is available. */
+static struct thread *
+thread_page_alloc (void) 
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (thread_cache_cnt > 0)
+    {
+      t = thread_cache[--thread_cache_cnt];
+      thread_cache_hits++;
+    }
+  else
+    thread_cache_misses++;
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (0);
+  return t;
+}
+
+/* Releases dying thread T's page into the thread cache, or back
+   to the page allocator if the cache is full.  Clearing the
+   magic number makes stale pointers to T fail is_thread(). */
+static void
+thread_page_free (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (is_thread (t));
+
+  t->magic = 0;
+  if (thread_cache_cnt < THREAD_CACHE_MAX)
+    thread_cache[thread_cache_cnt++] = t;
+  else
+    palloc_free_page (t);
+}
+
 /* Does basic initialization of T as a blocked thread named
    NAME. */
 static void
@@ -520,7 +1169,21 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  if (thread_mlfqs || thread_cfs)
+    {
+      /* Inherit the creating thread's scheduling history.  The
+         initial thread starts from scratch. */
+      struct thread *parent = running_thread ();
+      if (parent != t && is_thread (parent))
+        {
+          t->nice = parent->nice;
+          t->recent_cpu = parent->recent_cpu;
+        }
+      if (thread_mlfqs)
+        priority = mlfqs_priority (t);
+    }
+  t->priority = t->base_priority = priority;
+  list_init (&t->donors);
   t->magic = THREAD_MAGIC;
   sema_init(&(t->wait_sema), 0);
   sema_init(&(t->load_sema), 0);
@@ -544,18 +1207,155 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Adds T to the back of the run queue for its priority, or to
+   the CFS run queue if the completely fair scheduler is in
+   use. */
+static void
+ready_queue_push (struct thread *t) 
+{
+  int pri = t->priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= pri && pri <= PRI_MAX);
+
+  if (t->rt_period != 0)
+    {
+      /* A throttled thread is not really ready, so it does not
+         count toward ready_cnt. */
+      if (t->rt_throttled)
+        list_push_back (&rt_throttled_list, &t->elem);
+      else
+        {
+          list_insert_ordered (&rt_queue, &t->elem, rt_deadline_less, NULL);
+          ready_cnt++;
+        }
+      return;
+    }
+
+  ready_cnt++;
+  if (thread_cfs)
+    {
+      rb_insert (&cfs_queue, &t->cfs_elem);
+      return;
+    }
+  list_push_back (&ready_queues[pri], &t->elem);
+  ready_mask[pri / READY_MASK_BITS] |= 1u << (pri % READY_MASK_BITS);
+}
+
+/* Removes ready thread T from its run queue. */
+static void
+ready_queue_remove (struct thread *t) 
+{
+  int pri = t->priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  if (t->rt_period != 0)
+    {
+      list_remove (&t->elem);
+      if (!t->rt_throttled)
+        ready_cnt--;
+      return;
+    }
+
+  ready_cnt--;
+  if (thread_cfs)
+    {
+      rb_remove (&cfs_queue, &t->cfs_elem);
+      return;
+    }
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[pri]))
+    ready_mask[pri / READY_MASK_BITS] &= ~(1u << (pri % READY_MASK_BITS));
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   PRI_MIN - 1 if no thread is ready. */
+static int
+ready_queue_max_priority (void) 
+{
+  int word;
+
+  for (word = sizeof ready_mask / sizeof *ready_mask - 1; word >= 0; word--)
+    if (ready_mask[word] != 0)
+      return (word * READY_MASK_BITS
+              + (READY_MASK_BITS - 1 - __builtin_clz (ready_mask[word])));
+  return PRI_MIN - 1;
+}
+
+/* Returns true if some ready thread should run in place of CUR,
+   the running thread: under the completely fair scheduler, one
+   that trails CUR's vruntime by more than CFS_WAKEUP_GRAN;
+   otherwise, one with a higher priority than CUR.  Any ready
+   thread preempts the idle thread. */
+static bool
+ready_queue_preempts (const struct thread *cur) 
+{
+  if (ready_cnt == 0)
+    return false;
+  else if (cur == idle_thread)
+    return true;
+  else if (!list_empty (&rt_queue))
+    {
+      const struct thread *rt = list_entry (list_front (&rt_queue),
+                                            struct thread, elem);
+      return (cur->rt_period == 0 || cur->rt_throttled
+              || rt->rt_deadline < cur->rt_deadline);
+    }
+  else if (cur->rt_period != 0 && !cur->rt_throttled)
+    return false;
+  else if (thread_cfs)
+    {
+      const struct thread *min = rb_entry (rb_min (&cfs_queue),
+                                           struct thread, cfs_elem);
+      return min->vruntime + CFS_WAKEUP_GRAN < cur->vruntime;
+    }
+  else
+    return ready_queue_max_priority () > cur->priority;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   Threads of equal priority are scheduled round-robin. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int pri;
+  struct list *queue;
+  struct thread *t;
+
+  if (!list_empty (&rt_queue))
+    {
+      ready_cnt--;
+      return list_entry (list_pop_front (&rt_queue), struct thread, elem);
+    }
+
+  if (thread_cfs)
+    {
+      if (rb_empty (&cfs_queue))
+        return idle_thread;
+      cfs_update_min_vruntime ();
+      t = rb_entry (rb_min (&cfs_queue), struct thread, cfs_elem);
+      rb_remove (&cfs_queue, &t->cfs_elem);
+      ready_cnt--;
+      return t;
+    }
+
+  pri = ready_queue_max_priority ();
+  if (pri < PRI_MIN)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  queue = &ready_queues[pri];
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  if (list_empty (queue))
+    ready_mask[pri / READY_MASK_BITS] &= ~(1u << (pri % READY_MASK_BITS));
+  ready_cnt--;
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -590,6 +1390,7 @@ thread_schedule_tail (struct thread *prev)
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
+  fpu_activate ();
 #endif
 
   /* If the thread we switched from is dying, destroy its struct
@@ -600,7 +1401,7 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      thread_page_free (prev);
     }
 }
 
@@ -622,8 +1423,16 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* Account for the ticks that went by while the idle thread
+     had the timer in one-shot mode. */
+  if (cur == idle_thread)
+    idle_ticks += timer_idle_exit ();
+
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      trace_event (TRACE_SWITCH, cur, next->tid);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
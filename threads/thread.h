@@ -3,8 +3,10 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include <threads/synch.h>
+#include "threads/fixed-point.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -25,6 +27,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default nice value. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -77,12 +84,13 @@ typedef int tid_t;
    value, triggering the assertion.  (So don't add elements below 
    THREAD_MAGIC.)
 */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member has a triple purpose.  It can be an element
+   in the run queue (thread.c), an element in a semaphore wait
+   list (synch.c), or an element in the timer's sleep list
+   (devices/timer.c).  It can be used these ways only because
+   they are mutually exclusive: only a thread in the ready state
+   is on the run queue, whereas only a blocked thread is on a
+   semaphore wait list or the sleep list, and never on both. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -90,12 +98,44 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donations. */
     struct list_elem allelem;           /* List element for all threads list. */
 
     /* Shared between thread.c and synch.c. */
+    struct list donors;                 /* Threads donating priority to us. */
+    struct list_elem donor_elem;        /* List element for donors list. */
+    struct lock *waiting_lock;          /* Lock we are blocked on, if any. */
+
+    /* Owned by thread.c, used only by the MLFQS scheduler. */
+    int nice;                           /* Niceness. */
+    fixed_t recent_cpu;                 /* Recent CPU time received. */
+    bool cpu_changed;                   /* On cpu_changed_list? */
+    struct list_elem cpu_elem;          /* List element for cpu_changed_list. */
+
+    /* Owned by thread.c, used only by the CFS scheduler. */
+    int64_t vruntime;                   /* Weighted CPU time received. */
+    struct rb_elem cfs_elem;            /* Element in CFS run queue. */
+    int64_t run_ticks;                  /* # of timer ticks run. */
+
+    /* Owned by thread.c, used only by real-time threads. */
+    int64_t rt_period;                  /* Period in ticks, 0 if not RT. */
+    int64_t rt_runtime;                 /* Ticks of CPU time per period. */
+    int64_t rt_rel_deadline;            /* Deadline from period start. */
+    int64_t rt_period_start;            /* Tick current period began. */
+    int64_t rt_deadline;                /* Current absolute deadline. */
+    int64_t rt_budget;                  /* Ticks left this period. */
+    int rt_density;                     /* Share of CPU reserved, in 1/1000. */
+    bool rt_throttled;                  /* Budget used up this period? */
+    bool rt_missed;                     /* Missed current deadline? */
+
+    /* Shared between thread.c, synch.c, and devices/timer.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick to wake up at, if asleep. */
+    int64_t wakeup_ns;                  /* Time to wake up at, in ns. */
+
     struct list child_list;             /* Childs list */
     struct list_elem childelem;         /* List element for child list. */
 
@@ -117,6 +157,9 @@ struct thread
     bool load_failed;                   /* load status */
     struct file *executable;
     uint32_t saved_esp;                 /* saved kernel esp */
+
+    /* Owned by userprog/fpu.c. */
+    void *fpu_state;                    /* FPU save area, if FPU used. */
 #endif
 
     /* Owned by thread.c. */
@@ -128,6 +171,10 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use completely fair scheduler.
+   Controlled by kernel command-line option "-sched=cfs". */
+extern bool thread_cfs;
+
 void thread_init (void);
 void thread_start (void);
 
@@ -146,6 +193,8 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+void thread_refresh_priority (struct thread *);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -153,6 +202,11 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+bool thread_priority_less (const struct list_elem *, const struct list_elem *,
+                           void *aux);
+
+bool thread_set_deadline (int64_t period, int64_t runtime, int64_t deadline);
+int64_t thread_rt_next_replenish (void);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -0,0 +1,74 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#ifdef FILESYS
+#include "filesys/fsutil.h"
+#endif
+
+/* Number of records in the ring buffer.  Must be a power of 2. */
+#define TRACE_SIZE 2048
+
+/* Ring buffer.  Record number N is stored in trace[N %
+   TRACE_SIZE], and trace_cnt is the number of records ever
+   written, so the buffer holds records max(0, trace_cnt -
+   TRACE_SIZE) through trace_cnt - 1.  Accessed with interrupts
+   off. */
+static struct trace_record trace[TRACE_SIZE];
+static uint32_t trace_cnt;
+
+/* Records an event of the given TYPE concerning thread T, with
+   type-specific argument ARG.  May be called from any context,
+   including interrupt handlers. */
+void
+trace_event (enum trace_type type, const struct thread *t, int arg) 
+{
+  enum intr_level old_level;
+  struct trace_record *r;
+
+  old_level = intr_disable ();
+  r = &trace[trace_cnt % TRACE_SIZE];
+  r->tsc = clock_cycles ();
+  r->tick = timer_ticks ();
+  r->seq = trace_cnt++;
+  r->type = type;
+  r->tid = t->tid;
+  r->arg = arg;
+  intr_set_level (old_level);
+}
+
+#ifdef FILESYS
+/* Writes the trace buffer, oldest record first, to the scratch
+   device as file "sched.trace". */
+void
+trace_dump (char **argv UNUSED) 
+{
+  enum intr_level old_level;
+  struct trace_record *copy;
+  uint32_t cnt, first, i;
+
+  copy = malloc (sizeof trace);
+  if (copy == NULL)
+    PANIC ("couldn't allocate trace buffer");
+
+  /* Take a snapshot, so that the events caused by writing the
+     trace out don't overwrite it as we go. */
+  old_level = intr_disable ();
+  cnt = trace_cnt < TRACE_SIZE ? trace_cnt : TRACE_SIZE;
+  first = trace_cnt - cnt;
+  for (i = 0; i < cnt; i++)
+    copy[i] = trace[(first + i) % TRACE_SIZE];
+  intr_set_level (old_level);
+
+  printf ("Writing %"PRIu32" scheduler trace records to scratch device...\n",
+          cnt);
+  fsutil_append_data ("sched.trace", copy, cnt * sizeof *copy);
+  free (copy);
+}
+#endif /* FILESYS */
@@ -0,0 +1,47 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdint.h>
+
+/* Scheduler event trace.
+
+   The scheduler records each event below into a fixed-size ring
+   buffer in memory, overwriting the oldest records once it
+   fills up.  Recording takes a few dozen instructions with
+   interrupts off and never prints, so it disturbs timing far
+   less than printf() debugging.
+
+   The "sched-trace" action writes the buffer to the scratch
+   device as a file named "sched.trace", from which "pintos
+   --sched-trace=FILE" copies it back to the host.  The file is
+   simply a sequence of struct trace_record, oldest first, in
+   the machine's little-endian byte order. */
+
+/* Types of scheduler events. */
+enum trace_type
+  {
+    TRACE_SWITCH,               /* Context switch; ARG is next tid. */
+    TRACE_BLOCK,                /* Thread blocked. */
+    TRACE_UNBLOCK,              /* Thread made ready; ARG is priority. */
+    TRACE_WAKEUP,               /* Sleeping thread woken by the timer. */
+    TRACE_PRIORITY              /* Priority changed; ARG is new priority. */
+  };
+
+/* A trace record.  32 bytes. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time stamp counter, or 0 if none. */
+    int64_t tick;               /* Timer tick. */
+    uint32_t seq;               /* Sequence number. */
+    uint32_t type;              /* An enum trace_type. */
+    int32_t tid;                /* Thread the event concerns. */
+    int32_t arg;                /* Type-specific argument. */
+  };
+
+struct thread;
+void trace_event (enum trace_type, const struct thread *, int arg);
+#ifdef FILESYS
+void trace_dump (char **argv);
+#endif
+
+#endif /* threads/trace.h */
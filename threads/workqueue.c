@@ -0,0 +1,300 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A work queue. */
+struct workqueue 
+  {
+    const char *name;           /* Name, also given to worker threads. */
+    struct list_elem elem;      /* Element in all_queues. */
+    struct list work;           /* Work ready to run, oldest first. */
+    struct semaphore work_sema; /* Up'd once for each item in `work'. */
+    int queued_cnt;             /* # of items in `work'. */
+    int busy_cnt;               /* # of items queued or running. */
+    struct list flushers;       /* Threads in flush_workqueue(). */
+
+    /* Statistics. */
+    long long run_cnt;          /* # of items run. */
+    int max_depth;              /* Largest value of queued_cnt. */
+    int64_t latency_ns;         /* Total time from queueing to running. */
+    int64_t max_latency_ns;     /* Longest time from queueing to running. */
+  };
+
+/* A thread waiting in flush_workqueue(). */
+struct flusher 
+  {
+    struct list_elem elem;      /* Element in workqueue's `flushers'. */
+    struct semaphore done;      /* Up'd when the queue drains. */
+  };
+
+/* All work queues, for workqueue_print_stats(). */
+static struct list all_queues = LIST_INITIALIZER (all_queues);
+
+/* Delayed work of all queues, ordered by ascending due tick.
+   Drained by workqueue_tick() from the timer interrupt, which
+   may run before workqueue_init(), hence the static
+   initialization.
+
+   Like all of the work queue lists, accessed with interrupts
+   off. */
+static struct list delayed_list = LIST_INITIALIZER (delayed_list);
+
+/* Default work queue. */
+struct workqueue *system_wq;
+
+static thread_func worker;
+static void enqueue (struct workqueue *, struct work *);
+static bool due_less (const struct list_elem *, const struct list_elem *,
+                      void *aux);
+
+/* Creates the default work queue. */
+void
+workqueue_init (void) 
+{
+  system_wq = workqueue_create ("kworker", 1);
+}
+
+/* Creates and returns a work queue named NAME, served by
+   WORKER_CNT worker threads.  Returns a null pointer if memory
+   is not available.  Panics if a worker thread cannot be
+   created. */
+struct workqueue *
+workqueue_create (const char *name, int worker_cnt) 
+{
+  struct workqueue *wq;
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (name != NULL);
+  ASSERT (worker_cnt > 0);
+
+  wq = calloc (1, sizeof *wq);
+  if (wq == NULL)
+    return NULL;
+  wq->name = name;
+  list_init (&wq->work);
+  sema_init (&wq->work_sema, 0);
+  list_init (&wq->flushers);
+
+  old_level = intr_disable ();
+  list_push_back (&all_queues, &wq->elem);
+  intr_set_level (old_level);
+
+  for (i = 0; i < worker_cnt; i++)
+    if (thread_create (name, PRI_DEFAULT, worker, wq) == TID_ERROR)
+      PANIC ("%s: couldn't create worker thread", name);
+  return wq;
+}
+
+/* Initializes W to run FUNC when it is queued. */
+void
+work_init (struct work *w, work_func *func) 
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->wq = NULL;
+  w->pending = false;
+}
+
+/* Queues W on WQ to be run by one of WQ's worker threads.
+   Returns true if W was queued, false if it was already
+   pending.  May be called from an interrupt handler. */
+bool
+queue_work (struct workqueue *wq, struct work *w) 
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  if (!w->pending)
+    {
+      w->pending = true;
+      w->wq = wq;
+      enqueue (wq, w);
+      queued = true;
+    }
+  intr_set_level (old_level);
+
+  thread_preempt ();
+  return queued;
+}
+
+/* Queues W on WQ after approximately TICKS timer ticks.
+   Returns true if W was queued, false if it was already
+   pending.  May be called from an interrupt handler. */
+bool
+queue_delayed_work (struct workqueue *wq, struct work *w, int64_t ticks) 
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  if (ticks <= 0)
+    return queue_work (wq, w);
+
+  old_level = intr_disable ();
+  if (!w->pending)
+    {
+      w->pending = true;
+      w->wq = wq;
+      w->due = timer_ticks () + ticks;
+      list_insert_ordered (&delayed_list, &w->elem, due_less, NULL);
+      queued = true;
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Waits until all of the work queued on WQ, including work
+   queued while we wait, has finished running.  Delayed work
+   that is not yet due is not waited for.  Must not be called
+   from one of WQ's own worker threads, or from an interrupt
+   handler. */
+void
+flush_workqueue (struct workqueue *wq) 
+{
+  struct flusher f;
+  enum intr_level old_level;
+
+  ASSERT (wq != NULL);
+  ASSERT (!intr_context ());
+
+  sema_init (&f.done, 0);
+  old_level = intr_disable ();
+  if (wq->busy_cnt > 0)
+    {
+      list_push_back (&wq->flushers, &f.elem);
+      sema_down (&f.done);
+    }
+  intr_set_level (old_level);
+}
+
+/* Called by the timer interrupt handler at tick NOW to queue
+   the delayed work that has come due. */
+void
+workqueue_tick (int64_t now) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&delayed_list))
+    {
+      struct work *w = list_entry (list_front (&delayed_list),
+                                   struct work, elem);
+      if (w->due > now)
+        break;
+      list_pop_front (&delayed_list);
+      enqueue (w->wq, w);
+    }
+}
+
+/* Returns the tick at which the earliest delayed work is due,
+   or INT64_MAX if there is none.  Interrupts must be off. */
+int64_t
+workqueue_next_due (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (&delayed_list))
+    return INT64_MAX;
+  return list_entry (list_front (&delayed_list), struct work, elem)->due;
+}
+
+/* Prints work queue statistics. */
+void
+workqueue_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_queues); e != list_end (&all_queues);
+       e = list_next (e))
+    {
+      struct workqueue *wq = list_entry (e, struct workqueue, elem);
+      int64_t avg_ns = wq->run_cnt > 0 ? wq->latency_ns / wq->run_cnt : 0;
+
+      printf ("Workqueue \"%s\": %lld items run, max depth %d, "
+              "latency %"PRId64" us avg, %"PRId64" us max\n",
+              wq->name, wq->run_cnt, wq->max_depth,
+              avg_ns / 1000, wq->max_latency_ns / 1000);
+    }
+}
+
+/* Worker thread for work queue WQ_.  Runs WQ_'s work, one item
+   at a time, forever. */
+static void
+worker (void *wq_) 
+{
+  struct workqueue *wq = wq_;
+
+  for (;;) 
+    {
+      enum intr_level old_level;
+      struct work *w;
+      int64_t latency;
+
+      sema_down (&wq->work_sema);
+
+      old_level = intr_disable ();
+      w = list_entry (list_pop_front (&wq->work), struct work, elem);
+      wq->queued_cnt--;
+      w->pending = false;
+      latency = clock_ns () - w->queued_ns;
+      wq->run_cnt++;
+      wq->latency_ns += latency;
+      if (latency > wq->max_latency_ns)
+        wq->max_latency_ns = latency;
+      intr_set_level (old_level);
+
+      w->func (w);
+
+      /* Release the flushers once nothing is left to run. */
+      old_level = intr_disable ();
+      if (--wq->busy_cnt == 0)
+        while (!list_empty (&wq->flushers))
+          {
+            struct flusher *f = list_entry (list_pop_front (&wq->flushers),
+                                            struct flusher, elem);
+            sema_up (&f->done);
+          }
+      intr_set_level (old_level);
+    }
+}
+
+/* Adds W to the back of WQ's queue and wakes a worker.
+   Interrupts must be off. */
+static void
+enqueue (struct workqueue *wq, struct work *w) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&wq->work, &w->elem);
+  w->queued_ns = clock_ns ();
+  wq->busy_cnt++;
+  if (++wq->queued_cnt > wq->max_depth)
+    wq->max_depth = wq->queued_cnt;
+  sema_up (&wq->work_sema);
+}
+
+/* Orders work on delayed_list by ascending due tick. */
+static bool
+due_less (const struct list_elem *a_, const struct list_elem *b_,
+          void *aux UNUSED) 
+{
+  const struct work *a = list_entry (a_, struct work, elem);
+  const struct work *b = list_entry (b_, struct work, elem);
+
+  return a->due < b->due;
+}
@@ -0,0 +1,60 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Work queues.
+
+   A work queue runs functions ("work") on behalf of code that
+   cannot or should not run them itself: interrupt handlers,
+   which must not sleep, and latency-sensitive paths that would
+   rather not wait.  Each queue has one or more worker kernel
+   threads that take work off the queue in FIFO order and run
+   it.  Work may also be queued to run after a delay, measured
+   in timer ticks.
+
+   A struct work is embedded in the caller's own data, like a
+   struct list_elem, and must stay allocated until it has run.
+   Queueing work that is already pending has no effect, so the
+   same work can safely be queued from several places.
+
+   queue_work() and queue_delayed_work() may be called from
+   interrupt handlers.  flush_workqueue() sleeps. */
+
+struct work;
+struct workqueue;
+
+/* A function to run as work.  It is passed the struct work
+   that was queued, and may queue it again. */
+typedef void work_func (struct work *);
+
+/* A piece of work. */
+struct work 
+  {
+    struct list_elem elem;      /* Queue or delayed-work list element. */
+    work_func *func;            /* Function to run. */
+    struct workqueue *wq;       /* Queue it is pending on, if any. */
+    bool pending;               /* Queued or delayed but not yet run? */
+    int64_t due;                /* Delayed work: tick to queue at. */
+    int64_t queued_ns;          /* When queued, for latency statistics. */
+  };
+
+/* The default work queue, for work that needs no queue of its
+   own. */
+extern struct workqueue *system_wq;
+
+void workqueue_init (void);
+struct workqueue *workqueue_create (const char *name, int worker_cnt);
+
+void work_init (struct work *, work_func *);
+bool queue_work (struct workqueue *, struct work *);
+bool queue_delayed_work (struct workqueue *, struct work *, int64_t ticks);
+void flush_workqueue (struct workqueue *);
+
+void workqueue_tick (int64_t now);
+int64_t workqueue_next_due (void);
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
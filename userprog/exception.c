@@ -1,6 +1,7 @@
 #include "userprog/exception.h"
 #include <inttypes.h>
 #include <stdio.h>
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -15,6 +16,7 @@
 static long long page_fault_cnt;
 
 static void kill (struct intr_frame *);
+static void device_not_available (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 static bool install_page (void *, void *, bool);
 /* Registers handlers for interrupts that can be caused by user
@@ -51,8 +53,6 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -64,6 +64,14 @@ exception_init (void)
      We need to disable interrupts for page faults because the
      fault address is stored in CR2 and needs to be preserved. */
   intr_register_int (14, 0, INTR_OFF, page_fault, "#PF Page-Fault Exception");
+
+  /* The FPU is switched between processes lazily, on the first
+     floating-point instruction after a switch, which raises #NM.
+     Interrupts stay off so that the handover is not preempted
+     halfway. */
+  fpu_init ();
+  intr_register_int (7, 0, INTR_OFF, device_not_available,
+                     "#NM Device Not Available Exception");
 }
 
 /* Prints exception statistics. */
@@ -115,6 +123,21 @@ kill (struct intr_frame *f)
     }
 }
 
+/* #NM handler.  A user process executed a floating-point
+   instruction while another thread's state was in the FPU, so
+   give the FPU to this process and let it retry the
+   instruction.  The kernel never uses the FPU, so #NM from
+   kernel code is a bug. */
+static void
+device_not_available (struct intr_frame *f) 
+{
+  if (f->cs != SEL_UCSEG || !fpu_claim ())
+    {
+      intr_enable ();
+      kill (f);
+    }
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -0,0 +1,248 @@
+#include "userprog/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Lazy floating-point context switching.
+
+   The kernel is compiled with -msoft-float and never touches the
+   x87 or SSE registers itself, so switch_threads() saves only
+   the integer registers.  User processes may still use the
+   FPU, so its registers belong to whichever process last used
+   them: the "owner".
+
+   On every thread switch we set CR0.TS unless the incoming
+   thread is the owner.  With TS set, the first floating-point
+   or SSE instruction the thread executes raises #NM (Device Not
+   Available).  The handler clears TS, saves the registers into
+   the owner's save area, loads the current thread's registers
+   (or a fresh initial state, on first use), and makes it the
+   new owner.  A process that never uses floating point never
+   pays for a save area or a save/restore, and one that is the
+   only floating-point user pays for none after its first
+   trap.
+
+   Refer to [IA32-v3a] section 13.4 "Designing OS Facilities for
+   Saving x87 FPU, SSE and Extended States on Task or Context
+   Switches". */
+
+/* CR0 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR0_NE 0x00000020       /* Native FPU error reporting. */
+
+/* Save area sizes.  FXSAVE needs 512 bytes aligned on a 16-byte
+   boundary; the older FNSAVE needs 108 bytes. */
+#define FXSAVE_SIZE 512
+#define FNSAVE_SIZE 108
+#define FPU_ALIGN 16
+
+/* Initial MXCSR: all SIMD exceptions masked, round to nearest. */
+#define MXCSR_DEFAULT 0x1f80
+
+/* Thread whose state is in the FPU registers, or null. */
+static struct thread *fpu_owner;
+
+/* True if the CPU has an FPU at all. */
+static bool fpu_present;
+
+/* True to save state with FXSAVE, false for FNSAVE. */
+static bool fpu_fxsr;
+
+/* True if SSE is enabled. */
+static bool fpu_sse;
+
+/* Statistics. */
+static long long trap_cnt;      /* # of #NM exceptions. */
+static long long save_cnt;      /* # of states saved for another thread. */
+
+static inline uint32_t
+read_cr0 (void) 
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static inline void
+write_cr0 (uint32_t cr0) 
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+}
+
+/* Clears CR0.TS, allowing FPU instructions to execute. */
+static inline void
+clts (void) 
+{
+  asm volatile ("clts" : : : "memory");
+}
+
+/* Sets CR0.TS, so that the next FPU instruction traps. */
+static inline void
+stts (void) 
+{
+  write_cr0 (read_cr0 () | CR0_TS);
+}
+
+/* Returns T's save area, aligned as FXSAVE requires. */
+static void *
+save_area (struct thread *t) 
+{
+  return (void *) ROUND_UP ((uintptr_t) t->fpu_state, FPU_ALIGN);
+}
+
+/* Saves the FPU registers into T's save area. */
+static void
+save_state (struct thread *t) 
+{
+  void *area = save_area (t);
+  if (fpu_fxsr)
+    asm volatile ("fxsave %0" : "=m" (*(char (*)[FXSAVE_SIZE]) area));
+  else
+    asm volatile ("fnsave %0" : "=m" (*(char (*)[FNSAVE_SIZE]) area));
+}
+
+/* Loads the FPU registers from T's save area. */
+static void
+restore_state (struct thread *t) 
+{
+  void *area = save_area (t);
+  if (fpu_fxsr)
+    asm volatile ("fxrstor %0" : : "m" (*(char (*)[FXSAVE_SIZE]) area));
+  else
+    asm volatile ("frstor %0" : : "m" (*(char (*)[FNSAVE_SIZE]) area));
+}
+
+/* Puts the FPU registers into their initial state. */
+static void
+init_state (void) 
+{
+  asm volatile ("fninit");
+  if (fpu_sse)
+    {
+      uint32_t mxcsr = MXCSR_DEFAULT;
+      asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+    }
+}
+
+/* Turns on the FPU for use by user processes.  Without an FPU,
+   CR0.EM stays set and floating-point instructions keep raising
+   #NM. */
+void
+fpu_init (void) 
+{
+  uint32_t regs[4];
+
+  cpuid (1, regs);
+  fpu_present = (regs[3] & CPUID_FPU) != 0;
+  if (!fpu_present)
+    {
+      printf ("No floating-point unit.\n");
+      return;
+    }
+  fpu_fxsr = (regs[3] & CPUID_FXSR) != 0;
+  fpu_sse = fpu_fxsr && (regs[3] & CPUID_SSE) != 0;
+
+  /* The loader set CR0.EM so that stray FPU instructions trap.
+     Clear it and let CR0.TS do the trapping instead. */
+  write_cr0 ((read_cr0 () & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+
+  if (fpu_fxsr) 
+    {
+      uint32_t cr4 = read_cr4 () | CR4_OSFXSR;
+      if (fpu_sse)
+        cr4 |= CR4_OSXMMEXCPT;
+      write_cr4 (cr4);
+    }
+}
+
+/* Arranges for the FPU to trap on first use unless the running
+   thread already owns it.  Called with interrupts off on every
+   thread switch. */
+void
+fpu_activate (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!fpu_present)
+    return;
+  if (fpu_owner == thread_current ())
+    clts ();
+  else
+    stts ();
+}
+
+/* Discards T's FPU state and frees its save area.  Called as T
+   exits, with interrupts on. */
+void
+fpu_release (struct thread *t) 
+{
+  enum intr_level old_level = intr_disable ();
+  if (fpu_owner == t)
+    {
+      fpu_owner = NULL;
+      stts ();
+    }
+  intr_set_level (old_level);
+
+  free (t->fpu_state);
+  t->fpu_state = NULL;
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void) 
+{
+  printf ("FPU: %lld traps, %lld state saves\n", trap_cnt, save_cnt);
+}
+
+/* Hands the FPU to the running thread, in response to #NM.
+   Returns false if the thread cannot be given the FPU, because
+   there is none or because there is no memory for its save
+   area.  Called with interrupts off. */
+bool
+fpu_claim (void) 
+{
+  struct thread *cur = thread_current ();
+  bool fresh = false;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!fpu_present)
+    return false;
+
+  /* Allocate a save area on first use.  This may sleep, which
+     switches threads and sets CR0.TS again, so do it before
+     touching the FPU. */
+  if (cur->fpu_state == NULL)
+    {
+      cur->fpu_state = malloc ((fpu_fxsr ? FXSAVE_SIZE : FNSAVE_SIZE)
+                               + FPU_ALIGN - 1);
+      if (cur->fpu_state == NULL)
+        return false;
+      fresh = true;
+    }
+
+  trap_cnt++;
+  clts ();
+  if (fpu_owner == cur)
+    return true;
+  if (fpu_owner != NULL)
+    {
+      save_state (fpu_owner);
+      save_cnt++;
+    }
+  if (fresh)
+    init_state ();
+  else
+    restore_state (cur);
+  fpu_owner = cur;
+  return true;
+}
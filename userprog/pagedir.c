@@ -2,12 +2,15 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static void flush_tlb_global (void);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -17,6 +20,10 @@ uint32_t *
 pagedir_create (void) 
 {
   uint32_t *pd = palloc_get_page (0);
+
+  /* Share the kernel's page tables and 4 MB pages, which are
+     global, so that kernel translations survive switches between
+     page directories. */
   if (pd != NULL)
     memcpy (pd, init_page_dir, PGSIZE);
   return pd;
@@ -80,6 +87,10 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  /* Kernel memory mapped with a 4 MB page has no page table. */
+  if (*pde & PTE_PS)
+    return NULL;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -137,11 +148,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 }
 
 /* Marks user virtual page UPAGE "not present" in page
-   directory PD.  Later accesses to the page will fault.  Other
-   bits in the page table entry are preserved.
-   UPAGE need not be mapped. */
-void
-pagedir_clear_page (uint32_t *pd, void *upage) 
+   directory PD.  Returns true if the TLB entry for UPAGE must be
+   invalidated. */
+static bool
+clear_page (uint32_t *pd, void *upage) 
 {
   uint32_t *pte;
 
@@ -152,8 +162,47 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      return true;
+    }
+  else
+    return false;
+}
+
+/* Sets or clears, according to VALUE, bit BIT in the PTE for
+   virtual page VPAGE in PD.  Returns true if the TLB entry for
+   VPAGE must be invalidated, which is the case only if a set bit
+   was cleared: the CPU sets the accessed and dirty bits itself,
+   but not again for a translation it has cached with the bit
+   set. */
+static bool
+update_pte (uint32_t *pd, const void *vpage, uint32_t bit, bool value) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte == NULL)
+    return false;
+  else if (value)
+    {
+      *pte |= bit;
+      return false;
     }
+  else if (*pte & bit)
+    {
+      *pte &= ~bit;
+      return true;
+    }
+  else
+    return false;
+}
+
+/* Marks user virtual page UPAGE "not present" in page
+   directory PD.  Later accesses to the page will fault.  Other
+   bits in the page table entry are preserved.
+   UPAGE need not be mapped. */
+void
+pagedir_clear_page (uint32_t *pd, void *upage) 
+{
+  if (clear_page (pd, upage))
+    invalidate_page (pd, upage);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
@@ -172,17 +221,8 @@ pagedir_is_dirty (uint32_t *pd, const void *vpage)
 void
 pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  if (pte != NULL) 
-    {
-      if (dirty)
-        *pte |= PTE_D;
-      else 
-        {
-          *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
-        }
-    }
+  if (update_pte (pd, vpage, PTE_D, dirty))
+    invalidate_page (pd, vpage);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD has been
@@ -201,17 +241,98 @@ pagedir_is_accessed (uint32_t *pd, const void *vpage)
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  if (pte != NULL) 
+  if (update_pte (pd, vpage, PTE_A, accessed))
+    invalidate_page (pd, vpage);
+}
+
+/* Batched TLB invalidation.
+
+   Each of the functions above invalidates the TLB entry for the
+   one page it changes, with INVLPG.  A caller about to change
+   many pages at once, such as an eviction sweep or the unmapping
+   of a large region, can instead make the changes through a
+   batch, which records the pages and invalidates them all in
+   pagedir_batch_flush().  Past PAGEDIR_BATCH_MAX pages,
+   invalidating pages one by one costs more than refilling the
+   TLB, so the batch stops recording and flushes the whole TLB
+   instead.
+
+   Until the batch is flushed, the CPU may keep using the old
+   translations, so nothing that depends on the changes having
+   taken effect may happen before pagedir_batch_flush(). */
+
+/* Initializes batch B for changes to page directory PD. */
+void
+pagedir_batch_init (struct pagedir_batch *b, uint32_t *pd) 
+{
+  b->pd = pd;
+  b->page_cnt = 0;
+  b->overflow = false;
+  b->global = false;
+}
+
+/* Records that the TLB entry for VPAGE must be invalidated when
+   batch B is flushed. */
+static void
+batch_add (struct pagedir_batch *b, const void *vpage) 
+{
+  /* Kernel pages are mapped the same way in every page
+     directory, with global PTEs. */
+  if (!is_user_vaddr (vpage))
+    b->global = true;
+
+  if (b->page_cnt < PAGEDIR_BATCH_MAX)
+    b->pages[b->page_cnt++] = vpage;
+  else
+    b->overflow = true;
+}
+
+/* Like pagedir_clear_page(), but defers invalidation to B. */
+void
+pagedir_batch_clear_page (struct pagedir_batch *b, void *upage) 
+{
+  if (clear_page (b->pd, upage))
+    batch_add (b, upage);
+}
+
+/* Like pagedir_set_dirty(), but defers invalidation to B. */
+void
+pagedir_batch_set_dirty (struct pagedir_batch *b, const void *vpage,
+                         bool dirty) 
+{
+  if (update_pte (b->pd, vpage, PTE_D, dirty))
+    batch_add (b, vpage);
+}
+
+/* Like pagedir_set_accessed(), but defers invalidation to B. */
+void
+pagedir_batch_set_accessed (struct pagedir_batch *b, const void *vpage,
+                            bool accessed) 
+{
+  if (update_pte (b->pd, vpage, PTE_A, accessed))
+    batch_add (b, vpage);
+}
+
+/* Invalidates the TLB entries for every page changed through
+   batch B, and empties B. */
+void
+pagedir_batch_flush (struct pagedir_batch *b) 
+{
+  if (b->overflow)
     {
-      if (accessed)
-        *pte |= PTE_A;
-      else 
-        {
-          *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
-        }
+      if (b->global)
+        flush_tlb_global ();
+      else
+        invalidate_pagedir (b->pd);
     }
+  else
+    {
+      size_t i;
+
+      for (i = 0; i < b->page_cnt; i++)
+        invalidate_page (b->pd, b->pages[i]);
+    }
+  pagedir_batch_init (b, b->pd);
 }
 
 /* Loads page directory PD into the CPU's page directory base
@@ -261,3 +382,32 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/* Invalidates the TLB entry for virtual page VPAGE in PD, if it
+   might be cached: that is, if PD is the active page directory
+   or VPAGE is a kernel page, which is mapped the same way in
+   every page directory.  Unlike reloading CR3, this leaves every
+   other translation, and global ones, alone.  See [IA32-v2a]
+   "INVLPG--Invalidate TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vpage) 
+{
+  if (!is_user_vaddr (vpage) || active_pd () == pd)
+    asm volatile ("invlpg %0" : : "m" (*(const char *) vpage) : "memory");
+}
+
+/* Flushes the whole TLB, including global entries, which survive
+   a CR3 reload, by turning CR4.PGE off and on again.  See
+   [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+static void
+flush_tlb_global (void) 
+{
+  uint32_t cr4 = read_cr4 ();
+  if (cr4 & CR4_PGE)
+    {
+      write_cr4 (cr4 & ~CR4_PGE);
+      write_cr4 (cr4);
+    }
+  else
+    pagedir_activate (active_pd ());
+}
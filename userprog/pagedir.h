@@ -2,6 +2,7 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 uint32_t *pagedir_create (void);
@@ -15,4 +16,27 @@ bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
 
+/* Maximum number of pages a batch invalidates one by one, before
+   it falls back to flushing the whole TLB. */
+#define PAGEDIR_BATCH_MAX 32
+
+/* Changes to a page directory whose TLB invalidation is
+   deferred to pagedir_batch_flush(). */
+struct pagedir_batch
+  {
+    uint32_t *pd;                       /* Page directory changed. */
+    size_t page_cnt;                    /* Number of PAGES recorded. */
+    bool overflow;                      /* More than PAGEDIR_BATCH_MAX? */
+    bool global;                        /* Any kernel pages? */
+    const void *pages[PAGEDIR_BATCH_MAX]; /* Pages to invalidate. */
+  };
+
+void pagedir_batch_init (struct pagedir_batch *, uint32_t *pd);
+void pagedir_batch_clear_page (struct pagedir_batch *, void *upage);
+void pagedir_batch_set_dirty (struct pagedir_batch *, const void *upage,
+                              bool dirty);
+void pagedir_batch_set_accessed (struct pagedir_batch *, const void *upage,
+                                 bool accessed);
+void pagedir_batch_flush (struct pagedir_batch *);
+
 #endif /* userprog/pagedir.h */
@@ -1,15 +1,19 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
 #include <syscall-nr.h>
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
 #include "threads/thread.h"
 
 #include "threads/vaddr.h"
 #include "filesys/filesys.h"
 #include "devices/shutdown.h"
+#include "devices/timer.h"
 #include "userprog/pagedir.h"
 #include "filesys/file.h"
 #include "userprog/process.h"
+#include "userprog/tss.h"
 #include "lib/string.h"
 #include "threads/palloc.h"
 
@@ -33,6 +37,7 @@ bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int wait (pid_t pid);
 pid_t exec (const char *cmd_line);
+static bool sched_deadline (int period_ms, int runtime_ms, int deadline_ms);
 static bool install_page (void *, void *, bool);
 
 
@@ -43,6 +48,26 @@ syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
   sema_init (&syscall_sema,1);
+  sema_set_name (&syscall_sema, "syscall");
+
+  /* Also accept system calls through SYSENTER, which skips most
+     of the generic interrupt path.  User programs check CPUID
+     for the same feature before using it. */
+  if (cpu_has (CPUID_SEP))
+    {
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_ESP, (uintptr_t) tss_esp0 ());
+      wrmsr (MSR_SYSENTER_EIP, (uintptr_t) sysenter_entry);
+    }
+}
+
+/* Handles a system call made through SYSENTER.  Called from
+   sysenter_entry in sysenter.S with a partial interrupt frame in
+   which only the user's EIP, ESP, and EAX are meaningful. */
+void
+syscall_sysenter (struct intr_frame *f) 
+{
+  syscall_handler (f);
 }
 
 static void
@@ -135,6 +160,12 @@ syscall_handler (struct intr_frame *f)
       check_pointer(p+4);
       close(*(int *)(p+4));
       break;
+    /* Join or leave the real-time scheduling class. */
+    case SYS_SCHED_DEADLINE:
+      check_pointer(p+4);
+      check_pointer(p+12);
+      f->eax = sched_deadline(*(int *)(p+4), *(int *)(p+8), *(int *)(p+12));
+      break;
   }
 }
 
@@ -422,3 +453,28 @@ install_page(void *upage, void *kpage, bool writable){
 
   return(pagedir_get_page (t->pagedir, upage) == NULL && pagedir_set_page(t->pagedir, upage, kpage, writable));
 }
+
+/* Makes the running thread a real-time thread that needs
+   RUNTIME_MS milliseconds of CPU time in every PERIOD_MS, each
+   within DEADLINE_MS of the start of the period, or returns it
+   to normal scheduling if PERIOD_MS is 0.  Times are rounded to
+   whole timer ticks, the runtime up and the others down.
+   Returns false if the request is invalid or cannot be
+   admitted. */
+static bool
+sched_deadline (int period_ms, int runtime_ms, int deadline_ms)
+{
+  int64_t period, runtime, deadline;
+
+  if (period_ms == 0)
+    return thread_set_deadline (0, 0, 0);
+  if (period_ms < 0 || runtime_ms <= 0 || deadline_ms <= 0)
+    return false;
+
+  period = (int64_t) period_ms * TIMER_FREQ / 1000;
+  runtime = ((int64_t) runtime_ms * TIMER_FREQ + 999) / 1000;
+  deadline = (int64_t) deadline_ms * TIMER_FREQ / 1000;
+  if (period == 0 || deadline == 0)
+    return false;
+  return thread_set_deadline (period, runtime, deadline);
+}
@@ -3,7 +3,11 @@
 
 typedef int pid_t;
 
+struct intr_frame;
+
 void syscall_init (void);
+void syscall_sysenter (struct intr_frame *);
+void sysenter_entry (void);
 void exit (int status);
 
 #endif /* userprog/syscall.h */
@@ -96,6 +96,16 @@ tss_get (void)
   return tss;
 }
 
+/* Returns the address of the ring 0 stack pointer in the TSS,
+   which always holds the top of the running thread's kernel
+   stack.  The SYSENTER entry point reads it from there. */
+void **
+tss_esp0 (void) 
+{
+  ASSERT (tss != NULL);
+  return &tss->esp0;
+}
+
 /* Sets the ring 0 stack pointer in the TSS to point to the end
    of the thread stack. */
 void
@@ -36,15 +36,13 @@ void
 frame_init (){
 	number = 383;
 	frame_number = 0;
-	frames = malloc(number * sizeof(struct frame));
+	frames = calloc(number, sizeof(struct frame));
 	int index=0;
-	struct frame *frame;
 	for(;index<number;index++){
-		frame = (struct frame*) malloc (sizeof (struct frame));
-		frame -> page = palloc_get_page(PAL_USER);
-		frames[index] = *frame;
+		frames[index].page = palloc_get_page(PAL_USER);
 	}
 	lock_init (&frame_lock);
+	lock_set_name (&frame_lock, "frame");
 }
 
 /*
@@ -125,6 +123,7 @@ frame_corresponding_page(struct frame *frame){
 */
 int evict(){
 	uint32_t *pd = thread_current()->pagedir;
+	struct pagedir_batch batch;
 	int i;
 	int evict = -1;
 	for(i = 0; i < number; i++){
@@ -144,9 +143,11 @@ int evict(){
 			}
 		}
 	}
+	pagedir_batch_init(&batch, pd);
 	for(i = 0; i < evict; i++){
-		pagedir_set_accessed(pd, (&frames[i])->page,false);
+		pagedir_batch_set_accessed(&batch, (&frames[i])->page,false);
 	}
+	pagedir_batch_flush(&batch);
 	return evict;
 
 }
@@ -3,12 +3,14 @@
 #include "threads/synch.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 
 static struct hash pages;
 static struct lock page_lock;
+static struct kmem_cache page_cache;
 
 static bool DEBUG = false;
 
@@ -35,10 +37,19 @@ void unlock_page (){
 	lock_release (&page_lock);
 }
 
+/* Initializes the cache that supplemental page table entries
+   come from.  Called once, at boot. */
+void
+page_sup_init (void)
+{
+	kmem_cache_init (&page_cache, "page", sizeof (struct page), NULL);
+}
+
 struct hash *
 page_init (){
 	hash_init (&pages, page_hash, page_less, NULL);
 	lock_init (&page_lock);
+	lock_set_name (&page_lock, "page");
 	return &pages;
 }
 
@@ -47,7 +58,7 @@ Allocates a new page then adds to page table
 */
 bool
 page_set_sup(void *uaddr, struct file *file, off_t offset, size_t read, size_t zero, bool write){
-	struct page * page = (struct page*) malloc (sizeof (struct page));
+	struct page * page = kmem_cache_alloc (&page_cache);
 	page -> vaddr = uaddr;
 	page -> executable = file;
 	page -> num_read_bytes = read;
@@ -80,7 +91,7 @@ page_free (struct hash_elem free_me){
 		page = hash_entry (found_this_page, struct page, hash_elem);
 		palloc_free_page (&page->vaddr); //Free physical memory
 		hash_delete (&pages, &page->hash_elem); //Free entry in the page table
-		free (page); //Delete the structure
+		kmem_cache_free (&page_cache, page); //Delete the structure
 
 		return true;
 	} else {
@@ -24,6 +24,7 @@ struct page
 
 };
 
+void page_sup_init (void);
 struct hash * page_init (void);
 uint8_t *page_find (struct hash_elem);
 bool page_set_sup(void*,struct file*, off_t, size_t, size_t, bool);